@@ -42,6 +42,10 @@ void QueryAwait::begin(CompletionCallback callback) {
         this->queryCompleted(succeeded, std::unique_ptr<Pgsql::ResultResource>(results), errorInfo);
     };
     connection_->executeQuery(std::move(query_), queryCallback);
+    if (connection_->isExecutingQuery()) {
+        timings_.sent = QueryTimings::Clock::now();
+    }
+
     attachSocketIoHandler();
 }
 
@@ -67,13 +71,53 @@ p_Query QueryAwait::swapQuery(p_Query query) {
     return std::move(q);
 }
 
+void QueryAwait::cacheResult(sp_ResultCache cache, ResultCacheRequest request) {
+    resultCache_ = std::move(cache);
+    resultCacheRequest_ = std::move(request);
+}
+
+void QueryAwait::coalesce(InflightQueries * inflight, std::string key) {
+    inflight_ = inflight;
+    inflightKey_ = std::move(key);
+}
+
+void QueryAwait::finish(bool succeeded, std::unique_ptr<Pgsql::ResultResource> result,
+                        std::string const & errorInfo) {
+    always_assert(!connection_);
+    succeeded_ = succeeded;
+    result_ = std::move(result);
+    lastError_ = errorInfo;
+    timings_.completed = QueryTimings::Clock::now();
+    completed_ = true;
+    markAsFinished();
+}
+
+void QueryAwait::memoize(sp_QueryMemo memo, std::string key, unsigned generation) {
+    memo_ = std::move(memo);
+    memoKey_ = std::move(key);
+    memoGeneration_ = generation;
+}
+
 void QueryAwait::socketReady(bool read, bool write) {
     if (completed_) {
         return;
     }
 
+    bool sent = timings_.sent != QueryTimings::Clock::time_point();
+    if (read && sent && timings_.firstByte == QueryTimings::Clock::time_point()) {
+        timings_.firstByte = QueryTimings::Clock::now();
+    }
+
     connection_->socketReady(read, write);
 
+    /*
+     * The query is sent after the plan cache maintenance commands and the connection
+     * setup are completed, which may happen in any socket event.
+     */
+    if (!sent && connection_->isExecutingQuery()) {
+        timings_.sent = QueryTimings::Clock::now();
+    }
+
     if (completed_) {
         // Notify the client that the async operation completed
         markAsFinished();
@@ -123,8 +167,18 @@ void QueryAwait::queryCompleted(bool succeeded, std::unique_ptr<Pgsql::ResultRes
      */
     detachSocketIoHandler();
 
+    timings_.completed = QueryTimings::Clock::now();
     succeeded_ = succeeded;
     result_ = std::move(result);
+    if (succeeded_ && result_ && resultCache_) {
+        resultCache_->store(resultCacheRequest_, *result_);
+    }
+
+    if (inflight_) {
+        inflight_->complete(inflightKey_, succeeded_, result_.get(), errorInfo);
+        inflight_ = nullptr;
+    }
+
     lastError_ = errorInfo;
     callback_();
     completed_ = true;
@@ -133,12 +187,19 @@ void QueryAwait::queryCompleted(bool succeeded, std::unique_ptr<Pgsql::ResultRes
 void QueryAwait::unserialize(Cell & result) {
     if (succeeded_) {
         ENIG_DEBUG("QueryAwait::unserialize() OK");
-        auto queryResult = QueryResult::newInstance(std::move(result_));
+        // Results are memoized here, as the memo is only accessed from the request thread
+        if (memo_ && result_) {
+            memo_->store(memoKey_, memoGeneration_, *result_);
+        }
+
+        timings_.unserialized = QueryTimings::Clock::now();
+        auto queryResult = QueryResult::newInstance(std::move(result_), timings_);
         cellCopy(make_tv<KindOfObject>(queryResult.detach()), result);
     } else {
         ENIG_DEBUG("QueryAwait::unserialize() caught error");
         result.m_type = DataType::KindOfNull;
-        throwEnigmaException(lastError_);
+        timings_.unserialized = QueryTimings::Clock::now();
+        throwEnigmaException(lastError_, timings_);
     }
 }
 
@@ -178,8 +239,8 @@ void QueryAwait::fdChanged() {
 
 
 
-Connection::Connection(Pgsql::ConnectionOptions const & options, unsigned planCacheSize)
-        : options_(options), planCache_(planCacheSize)
+Connection::Connection(Pgsql::ConnectionOptions const & options, unsigned planCacheSize, size_t planCacheMemory)
+        : options_(options), planCache_(planCacheSize, planCacheMemory)
 {}
 
 void Connection::ensureConnected() {
@@ -188,28 +249,103 @@ void Connection::ensureConnected() {
     }
 }
 
+/*
+ * Synchronously prepares and describes plans scheduled by the plan cache and deallocates
+ * statements that were evicted from the plan cache.
+ */
+void Connection::flushPlanCache() {
+    restorePlans();
+    describePlans();
+    // Statements after a failed DEALLOCATE are rescheduled, so this takes more than one command in that case
+    while (canDeallocatePlans()) {
+        ENIG_DEBUG("Connection::flushPlanCache()");
+        internalCommand_ = InternalCommand::Deallocate;
+        resource_->sendQuery(planCache_.takeDeallocationCommand());
+        internalCommandCompleted();
+    }
+}
+
+bool Connection::canDeallocatePlans() const {
+    /*
+     * A failing DEALLOCATE would abort the transaction of the user,
+     * so evicted statements are only deallocated outside of transaction blocks.
+     */
+    return planCache_.hasEvictedPlans()
+        && state_ == State::Idle
+        && resource_->transactionStatus() == Pgsql::ConnectionResource::TransactionStatus::Idle;
+}
+
 void Connection::connect() {
     if (state_ != State::Dead) {
         throw EnigmaException("Already connected");
     }
 
-    planCache_.clear();
+    planCache_.connectionReset();
     if (!resource_) {
         ENIG_DEBUG("Connection::connect()");
         resource_ = std::unique_ptr<Pgsql::ConnectionResource>(
                 new Pgsql::ConnectionResource(options_, Pgsql::ConnectionInit::InitSync));
     } else {
+        reconnects_.fetch_add(1, std::memory_order_relaxed);
         resource_->reset();
     }
 
     state_ = State::Idle;
+    restorePlans();
 }
 
 void Connection::reset() {
     ENIG_DEBUG("Connection::reset()");
-    planCache_.clear();
+    planCache_.connectionReset();
+    reconnects_.fetch_add(1, std::memory_order_relaxed);
     resource_->reset();
     state_ = State::Idle;
+    restorePlans();
+}
+
+/*
+ * Synchronously prepares the plans that were kept from the previous connection
+ * or scheduled for preparation by PlanCache::warm().
+ */
+void Connection::restorePlans() {
+    if (!planCache_.hasUnpreparedPlans()) {
+        return;
+    }
+
+    // Plans after a failed PREPARE are rescheduled, so this takes more than one command in that case
+    while (planCache_.hasUnpreparedPlans()) {
+        auto command = planCache_.takePrepareCommand();
+        if (command.empty()) {
+            break;
+        }
+
+        ENIG_DEBUG("Connection::restorePlans()");
+        internalCommand_ = InternalCommand::PreparePlans;
+        resource_->sendQuery(command);
+        internalCommandCompleted();
+    }
+
+    failedStatement_.clear();
+}
+
+/*
+ * Synchronously describes the statements of plans scheduled by PlanCache::requestDescription().
+ */
+void Connection::describePlans() {
+    while (planCache_.hasUndescribedPlans()) {
+        auto statement = planCache_.takeUndescribedStatement();
+        if (statement.empty()) {
+            break;
+        }
+
+        ENIG_DEBUG("Connection::describePlans(): " << statement.c_str());
+        auto result = resource_->describePrepared(statement);
+        if (result->status() == Pgsql::ResultResource::Status::CommandOk) {
+            planCache_.planDescribed(PlanDescription::fromResult(*result));
+        } else {
+            planCache_.planDescribed(nullptr);
+        }
+    }
 }
 
 void Connection::beginConnect() {
@@ -217,7 +353,7 @@ void Connection::beginConnect() {
         throw EnigmaException("Already connected");
     }
 
-    planCache_.clear();
+    planCache_.connectionReset();
     writing_ = true;
     if (!resource_) {
         ENIG_DEBUG("Connection::beginConnect()");
@@ -225,6 +361,7 @@ void Connection::beginConnect() {
                 new Pgsql::ConnectionResource(options_, Pgsql::ConnectionInit::InitAsync));
         state_ = State::Connecting;
     } else {
+        reconnects_.fetch_add(1, std::memory_order_relaxed);
         resource_->resetStart();
         state_ = State::Resetting;
     }
@@ -232,8 +369,9 @@ void Connection::beginConnect() {
 
 void Connection::beginReset() {
     writing_ = true;
-    planCache_.clear();
+    planCache_.connectionReset();
     ENIG_DEBUG("Connection::beginReset()");
+    reconnects_.fetch_add(1, std::memory_order_relaxed);
     resource_->resetStart();
     state_ = State::Resetting;
 }
@@ -278,13 +416,104 @@ void Connection::setStateChangeCallback(StateChangeCallback callback) {
 
 void Connection::beginQuery() {
     ENIG_DEBUG("Connection::beginQuery()");
-    nextQuery_->send(*resource_.get());
+    if (!beginInternalCommand()) {
+        nextQuery_->send(*resource_.get());
+    }
 
     lastError_.clear();
     writing_ = true;
     state_ = State::Executing;
 }
 
+/*
+ * Sends pending plan cache maintenance commands to the server.
+ * The queued query is sent after the command completes.
+ */
+bool Connection::beginInternalCommand() {
+    std::string command;
+    if (planCache_.hasUnpreparedPlans()) {
+        internalCommand_ = InternalCommand::PreparePlans;
+        command = planCache_.takePrepareCommand();
+    }
+
+    if (command.empty() && planCache_.hasUndescribedPlans()) {
+        auto statement = planCache_.takeUndescribedStatement();
+        if (!statement.empty()) {
+            ENIG_DEBUG("Connection::beginInternalCommand(): describe " << statement.c_str());
+            internalCommand_ = InternalCommand::DescribePlan;
+            resource_->sendDescribePrepared(statement);
+            return true;
+        }
+    }
+
+    if (command.empty() && canDeallocatePlans()) {
+        internalCommand_ = InternalCommand::Deallocate;
+        command = planCache_.takeDeallocationCommand();
+    }
+
+    if (command.empty()) {
+        internalCommand_ = InternalCommand::None;
+        return false;
+    }
+
+    ENIG_DEBUG("Connection::beginInternalCommand()");
+    resource_->sendQuery(command);
+    return true;
+}
+
+void Connection::internalCommandCompleted() {
+    auto command = internalCommand_;
+    internalCommand_ = InternalCommand::None;
+    auto results = resource_->getResults();
+    if (command == InternalCommand::PreparePlans) {
+        unsigned prepared = 0;
+        while (prepared < results.size()
+               && results[prepared]->status() == Pgsql::ResultResource::Status::CommandOk) {
+            prepared++;
+        }
+
+        failedStatement_ = planCache_.plansPrepared(prepared);
+        if (!failedStatement_.empty() && prepared < results.size()) {
+            failedStatementError_ = results[prepared]->errorMessage();
+        }
+    } else if (command == InternalCommand::Deallocate) {
+        unsigned deallocated = 0;
+        while (deallocated < results.size()
+               && results[deallocated]->status() == Pgsql::ResultResource::Status::CommandOk) {
+            deallocated++;
+        }
+
+        planCache_.statementsDeallocated(deallocated);
+    } else if (command == InternalCommand::DescribePlan) {
+        if (!results.empty() && results[0]->status() == Pgsql::ResultResource::Status::CommandOk) {
+            planCache_.planDescribed(PlanDescription::fromResult(*results[0]));
+        } else {
+            planCache_.planDescribed(nullptr);
+        }
+    }
+
+    // Other errors of maintenance commands are not reported to the user
+}
+
+/*
+ * Fails the queued query with the error of its PREPARE command if its statement couldn't be prepared.
+ */
+bool Connection::failQueryOnPrepareError() {
+    if (failedStatement_.empty()) {
+        return false;
+    }
+
+    bool failed = nextQuery_->type() == Query::Type::Prepared
+            && nextQuery_->statement().toCppString() == failedStatement_;
+    failedStatement_.clear();
+    if (failed) {
+        lastError_ = failedStatementError_;
+        finishQuery(false, nullptr);
+    }
+
+    return failed;
+}
+
 void Connection::finishQuery(bool succeeded, std::unique_ptr<Pgsql::ResultResource> result) {
     if (!hasQueuedQuery_) {
         return;
@@ -334,9 +563,25 @@ void Connection::socketReady(bool read, bool write) {
 void Connection::queryCompleted() {
     ENIG_DEBUG("Connection::queryCompleted()");
     state_ = State::Idle;
+    if (internalCommand_ != InternalCommand::None) {
+        internalCommandCompleted();
+        if (!hasQueuedQuery_ || failQueryOnPrepareError()) {
+            return;
+        }
+
+        if (resource_->status() == Pgsql::ConnectionResource::Status::Ok) {
+            beginQuery();
+            return;
+        }
+    }
+
     auto result = resource_->getResult();
     if (!result) {
         lastError_ = resource_->errorMessage();
+        if (resource_->status() == Pgsql::ConnectionResource::Status::Bad) {
+            markAsDead(lastError_);
+        }
+
         finishQuery(false, nullptr);
     } else {
         bool succeeded = isQuerySuccessful(*result.get(), lastError_);
@@ -368,6 +613,14 @@ bool Connection::isQuerySuccessful(Pgsql::ResultResource & result, std::string &
             if (lastError.empty()) {
                 lastError = resource_->errorMessage();
             }
+
+            /*
+             * The server closed the connection (eg. the backend was terminated);
+             * reconnect before the next query, restoring the hot plans.
+             */
+            if (resource_->status() == Pgsql::ConnectionResource::Status::Bad) {
+                markAsDead(lastError);
+            }
             return false;
 
         default:
@@ -417,6 +670,7 @@ void Connection::connectionDied() {
 void Connection::markAsDead(std::string const & reason) {
     ENIG_DEBUG("Connection::markAsDead(): " << reason.c_str());
     state_ = State::Dead;
+    internalCommand_ = InternalCommand::None;
     lastError_ = reason;
     if (stateChangeCallback_) {
         stateChangeCallback_(*this, state_);
@@ -4,6 +4,7 @@
 #include "hphp/runtime/ext/extension.h"
 #include "hphp/runtime/ext/asio/socket-event.h"
 #include "hphp/runtime/ext/asio/asio-external-thread-event.h"
+#include "enigma-cache.h"
 #include "enigma-common.h"
 #include "enigma-plan.h"
 #include "enigma-query.h"
@@ -26,20 +27,43 @@ public:
     typedef std::function<void(bool, Pgsql::ResultResource *, std::string)> QueryCompletionCallback;
     typedef std::function<void(Connection &, State)> StateChangeCallback;
 
-    Connection(Pgsql::ConnectionOptions const & options, unsigned planCacheSize);
+    Connection(Pgsql::ConnectionOptions const & options, unsigned planCacheSize, size_t planCacheMemory);
 
     void ensureConnected();
+    void flushPlanCache();
+    void describePlans();
     void beginReset();
     void executeQuery(p_Query query, QueryCompletionCallback callback);
     void cancelQuery();
 
     void setStateChangeCallback(StateChangeCallback callback);
+
+    /*
+     * Current state of the connection; may be read from other threads.
+     */
+    inline State state() const {
+        return state_.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Number of times the connection was reset after it was first established.
+     */
+    inline uint64_t reconnects() const {
+        return reconnects_.load(std::memory_order_relaxed);
+    }
     bool isQuerySuccessful(Pgsql::ResultResource & result, std::string & lastError);
 
     inline bool inTransaction() const {
         return resource_->inTransaction();
     }
 
+    /*
+     * Returns whether the connection is established and not in a transaction block.
+     */
+    inline bool isIdle() const {
+        return state_ == State::Idle && !resource_->inTransaction();
+    }
+
     inline bool isConnecting() const {
         return state_ == State::Connecting || state_ == State::Resetting;
     }
@@ -48,6 +72,13 @@ public:
         return writing_;
     }
 
+    /*
+     * Returns whether the queued query was sent to the server (ie. no maintenance command is running before it).
+     */
+    inline bool isExecutingQuery() const {
+        return state_ == State::Executing && internalCommand_ == InternalCommand::None;
+    }
+
     inline int socket() const {
         if (resource_) {
             return resource_->socket();
@@ -76,10 +107,25 @@ protected:
 private:
     Pgsql::ConnectionOptions options_;
     std::unique_ptr<Pgsql::ConnectionResource> resource_{ nullptr };
-    State state_{ State::Dead };
+    std::atomic<State> state_{ State::Dead };
+    std::atomic<uint64_t> reconnects_{ 0 };
     bool writing_{ true };
 
     bool hasQueuedQuery_ { false };
+    /*
+     * Plan cache maintenance command being executed before sending the queued query
+     */
+    enum class InternalCommand {
+        None,
+        PreparePlans, // preparing scheduled plans
+        DescribePlan, // describing a prepared statement
+        Deallocate    // deallocating statements evicted from the plan cache
+    };
+
+    InternalCommand internalCommand_ { InternalCommand::None };
+    // Statement that couldn't be prepared by the last PreparePlans command, and the error
+    std::string failedStatement_;
+    std::string failedStatementError_;
     p_Query nextQuery_;
     PlanCache planCache_;
     QueryCompletionCallback queryCallback_;
@@ -90,6 +136,11 @@ private:
     void reset();
     void beginConnect();
     void beginQuery();
+    bool beginInternalCommand();
+    void internalCommandCompleted();
+    bool failQueryOnPrepareError();
+    void restorePlans();
+    bool canDeallocatePlans() const;
     void finishQuery(bool succeeded, std::unique_ptr<Pgsql::ResultResource> result);
     void queryCompleted();
     void processPollingStatus(Pgsql::ConnectionResource::PollingStatus status);
@@ -145,6 +196,33 @@ public:
 
     p_Query swapQuery(p_Query query);
 
+    inline QueryTimings & timings() {
+        return timings_;
+    }
+
+    /*
+     * Stores the result of the query in the result cache if the query succeeds.
+     * Must be called before the query is enqueued.
+     */
+    void cacheResult(sp_ResultCache cache, ResultCacheRequest request);
+
+    /*
+     * Passes the result of the query to the identical queries that are waiting for it.
+     * Must be called before the query is enqueued.
+     */
+    void coalesce(InflightQueries * inflight, std::string key);
+
+    /*
+     * Completes a query that wasn't executed on a connection (eg. it waited for the result
+     * of an identical query), and notifies the client.
+     */
+    void finish(bool succeeded, std::unique_ptr<Pgsql::ResultResource> result, std::string const & errorInfo);
+
+    /*
+     * Stores the result in the request-scoped memo of the pool handle when it's passed to the client.
+     */
+    void memoize(sp_QueryMemo memo, std::string key, unsigned generation);
+
 protected:
     sp_Connection connection_;
 
@@ -167,6 +245,14 @@ private:
     std::string lastError_;
     p_Query query_{ nullptr };
     CompletionCallback callback_;
+    QueryTimings timings_;
+    sp_ResultCache resultCache_;
+    ResultCacheRequest resultCacheRequest_;
+    InflightQueries * inflight_{ nullptr };
+    std::string inflightKey_;
+    sp_QueryMemo memo_;
+    std::string memoKey_;
+    unsigned memoGeneration_{ 0 };
 };
 
 }
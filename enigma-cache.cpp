@@ -0,0 +1,453 @@
+#include "enigma-cache.h"
+#include "enigma-async.h"
+#include "enigma-query.h"
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace HPHP {
+namespace Enigma {
+
+namespace {
+
+// Invalidation counter of tags that aren't tracked; never matches a tracked tag
+const uint64_t UntrackedTag = ~(uint64_t)0;
+
+void appendInt(std::string & key, uint32_t value) {
+    key.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+std::string quoteIdentifier(std::string const & identifier) {
+    std::string quoted("\"");
+    for (auto c : identifier) {
+        if (c == '"') {
+            quoted.push_back('"');
+        }
+
+        quoted.push_back(c);
+    }
+
+    quoted.push_back('"');
+    return quoted;
+}
+
+}
+
+ResultCache::Entry::Entry(PGresult * r, std::shared_ptr<std::string const> tz,
+                          std::chrono::steady_clock::time_point exp, size_t size, std::vector<std::string> t)
+        : result(r), serverTimezone(std::move(tz)), expires(exp), memoryUsage(size), tags(std::move(t))
+{}
+
+ResultCache::Entry::~Entry() {
+    if (result) {
+        PQclear(result);
+    }
+}
+
+ResultCache::ResultCache()
+        : entries_(MaxEntries)
+{
+    entries_.setPruneHook([this] (std::string key, sp_Entry && entry) {
+        entryEvicted(key, *entry);
+    });
+}
+
+void ResultCache::setMaxMemory(size_t maxMemory) {
+    Lock l(lock_);
+    maxMemory_ = maxMemory;
+    while (memoryUsage_ > maxMemory_ && !entries_.empty()) {
+        entries_.prune(1);
+    }
+}
+
+/*
+ * The key is the rewritten command followed by the result format and the wire format of
+ * each parameter; the full parameter data is used instead of a hash to rule out collisions.
+ */
+std::string ResultCache::makeKey(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                 unsigned flags) {
+    std::string key;
+    key.reserve(planInfo.rewrittenCommand.size() + 2 + params.count() * 16);
+    key.append(planInfo.rewrittenCommand);
+    key.push_back('\0');
+    key.push_back((flags & Query::kBinary) ? 'b' : 't');
+
+    auto values = params.buffer();
+    auto lengths = params.lengths();
+    auto formats = params.formats();
+    auto const & types = params.types();
+    for (int i = 0; i < params.count(); i++) {
+        if (values[i] == nullptr) {
+            key.push_back('n');
+            continue;
+        }
+
+        key.push_back((formats != nullptr && formats[i]) ? 'b' : 't');
+        appendInt(key, i < (int)types.size() ? types[i] : 0);
+        auto length = lengths != nullptr ? (size_t)lengths[i] : strlen(values[i]);
+        appendInt(key, (uint32_t)length);
+        key.append(values[i], length);
+    }
+
+    return key;
+}
+
+Pgsql::p_ResultResource ResultCache::lookup(std::string const & key) {
+    sp_Entry entry;
+    {
+        Lock l(lock_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+
+        if (it->second->expires <= std::chrono::steady_clock::now()) {
+            removeEntry(key);
+            return nullptr;
+        }
+
+        entry = it->second;
+    }
+
+    // The cached result is never modified, so it can be copied without holding the lock
+    auto copy = PQcopyResult(entry->result, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES);
+    if (copy == nullptr) {
+        return nullptr;
+    }
+
+    return Pgsql::p_ResultResource(new Pgsql::ResultResource(copy, entry->serverTimezone));
+}
+
+void ResultCache::store(ResultCacheRequest const & request, Pgsql::ResultResource const & result) {
+    if (!request.enabled() || result.status() != Pgsql::ResultResource::Status::TuplesOk) {
+        return;
+    }
+
+    auto size = result.memoryUsage() + request.key.size();
+    auto copy = result.copyTuples();
+    if (copy == nullptr) {
+        return;
+    }
+
+    auto expires = std::chrono::steady_clock::now()
+            + std::chrono::seconds(static_cast<int64_t>(request.ttl));
+    auto entry = std::make_shared<Entry const>(copy, result.serverTimezone(), expires, size, request.tags);
+
+    Lock l(lock_);
+    removeEntry(request.key);
+
+    // Results that don't fit in the cache on their own aren't worth evicting everything else for
+    if (size > maxMemory_) {
+        return;
+    }
+
+    // The result may predate a change announced by a notification we've already processed
+    for (size_t i = 0; i < request.tags.size(); i++) {
+        auto it = tagGenerations_.find(request.tags[i]);
+        if (it == tagGenerations_.end() || i >= request.tagGenerations.size()
+            || it->second != request.tagGenerations[i]) {
+            return;
+        }
+    }
+
+    entries_.set(request.key, entry);
+    memoryUsage_ += size;
+    for (auto const & tag : request.tags) {
+        taggedKeys_[tag].insert(request.key);
+    }
+
+    // Evict least recently used results until we're within the memory budget
+    while (memoryUsage_ > maxMemory_ && entries_.size() > 1) {
+        entries_.prune(1);
+    }
+}
+
+void ResultCache::clear() {
+    Lock l(lock_);
+    entries_.clear();
+    taggedKeys_.clear();
+    memoryUsage_ = 0;
+}
+
+void ResultCache::snapshotTags(ResultCacheRequest & request) {
+    Lock l(lock_);
+    request.tagGenerations.clear();
+    for (auto const & tag : request.tags) {
+        auto it = tagGenerations_.find(tag);
+        request.tagGenerations.push_back(it != tagGenerations_.end() ? it->second : UntrackedTag);
+    }
+}
+
+void ResultCache::activateTag(std::string const & tag) {
+    Lock l(lock_);
+    if (tagGenerations_.find(tag) == tagGenerations_.end()) {
+        tagGenerations_[tag] = ++lastTagGeneration_;
+    }
+}
+
+void ResultCache::invalidateTag(std::string const & tag) {
+    Lock l(lock_);
+    auto generation = tagGenerations_.find(tag);
+    if (generation != tagGenerations_.end()) {
+        generation->second = ++lastTagGeneration_;
+    }
+
+    auto it = taggedKeys_.find(tag);
+    if (it == taggedKeys_.end()) {
+        return;
+    }
+
+    auto keys = std::move(it->second);
+    taggedKeys_.erase(it);
+    for (auto const & key : keys) {
+        removeEntry(key);
+    }
+}
+
+void ResultCache::deactivateTags() {
+    Lock l(lock_);
+    tagGenerations_.clear();
+    auto taggedKeys = std::move(taggedKeys_);
+    taggedKeys_.clear();
+    for (auto const & tag : taggedKeys) {
+        for (auto const & key : tag.second) {
+            removeEntry(key);
+        }
+    }
+}
+
+void ResultCache::entryEvicted(std::string const & key, Entry const & entry) {
+    memoryUsage_ -= entry.memoryUsage;
+    for (auto const & tag : entry.tags) {
+        auto it = taggedKeys_.find(tag);
+        if (it != taggedKeys_.end()) {
+            it->second.erase(key);
+            if (it->second.empty()) {
+                taggedKeys_.erase(it);
+            }
+        }
+    }
+}
+
+void ResultCache::removeEntry(std::string const & key) {
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        // Keep the entry alive until it's unlinked from the tag index
+        auto entry = it->second;
+        entries_.erase(key);
+        entryEvicted(key, *entry);
+    }
+}
+
+
+
+Pgsql::p_ResultResource QueryMemo::lookup(std::string const & key) const {
+    auto it = results_.find(key);
+    if (it == results_.end()) {
+        return nullptr;
+    }
+
+    auto copy = it->second->copyTuples();
+    if (copy == nullptr) {
+        return nullptr;
+    }
+
+    return Pgsql::p_ResultResource(new Pgsql::ResultResource(copy, it->second->serverTimezone()));
+}
+
+void QueryMemo::store(std::string const & key, unsigned generation, Pgsql::ResultResource const & result) {
+    if (generation != generation_ || results_.size() >= MaxResults
+        || result.status() != Pgsql::ResultResource::Status::TuplesOk) {
+        return;
+    }
+
+    auto copy = result.copyTuples();
+    if (copy != nullptr) {
+        results_[key].reset(new Pgsql::ResultResource(copy, result.serverTimezone()));
+    }
+}
+
+void QueryMemo::invalidate() {
+    generation_++;
+    results_.clear();
+}
+
+
+
+QueryAwait * InflightQueries::follow(std::string const & key) {
+    Lock l(lock_);
+    auto it = followers_.find(key);
+    if (it == followers_.end()) {
+        followers_.insert(std::make_pair(key, std::vector<QueryAwait *>()));
+        return nullptr;
+    }
+
+    auto event = new QueryAwait(nullptr);
+    it->second.push_back(event);
+    return event;
+}
+
+void InflightQueries::complete(std::string const & key, bool succeeded, Pgsql::ResultResource const * result,
+                               std::string const & errorInfo) {
+    std::vector<QueryAwait *> followers;
+    {
+        Lock l(lock_);
+        auto it = followers_.find(key);
+        if (it == followers_.end()) {
+            return;
+        }
+
+        followers.swap(it->second);
+        followers_.erase(it);
+    }
+
+    for (auto follower : followers) {
+        Pgsql::p_ResultResource copy;
+        if (result != nullptr) {
+            auto tuples = result->copyTuples();
+            if (tuples != nullptr) {
+                copy.reset(new Pgsql::ResultResource(tuples, result->serverTimezone()));
+            }
+        }
+
+        if (succeeded && !copy) {
+            follower->finish(false, nullptr, "Failed to copy query result");
+        } else {
+            follower->finish(succeeded, std::move(copy), errorInfo);
+        }
+    }
+}
+
+
+
+ResultCacheListener::ResultCacheListener(Pgsql::ConnectionOptions const & options, sp_ResultCache cache)
+        : options_(options), cache_(std::move(cache))
+{}
+
+ResultCacheListener::~ResultCacheListener() {
+    if (thread_.joinable()) {
+        stopping_.store(true);
+        wakeup();
+        thread_.join();
+    }
+
+    for (auto fd : wakeupPipe_) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+void ResultCacheListener::listen(std::vector<std::string> const & channels) {
+    Lock l(lock_);
+    bool added = false;
+    for (auto const & channel : channels) {
+        if (channels_.insert(channel).second) {
+            pendingChannels_.push_back(channel);
+            added = true;
+        }
+    }
+
+    if (!thread_.joinable() && !pendingChannels_.empty()) {
+        // The connection is opened by the listener thread, so requests never wait for it
+        if (wakeupPipe_[0] == -1 && pipe2(wakeupPipe_, O_NONBLOCK | O_CLOEXEC) != 0) {
+            LOG(ERROR) << "Failed to create result cache listener wakeup pipe";
+            return;
+        }
+
+        thread_ = std::thread([this] { run(); });
+    } else if (added) {
+        wakeup();
+    }
+}
+
+void ResultCacheListener::run() {
+    while (!stopping_.load()) {
+        if (!connection_ || connection_->status() != Pgsql::ConnectionResource::Status::Ok) {
+            /*
+             * Notifications sent while we're disconnected are lost, so tagged results
+             * can't be trusted until we're listening on their channels again.
+             */
+            cache_->deactivateTags();
+            if (!connect()) {
+                waitForEvents(-1, ReconnectInterval);
+                continue;
+            }
+
+            Lock l(lock_);
+            pendingChannels_.assign(channels_.begin(), channels_.end());
+        }
+
+        try {
+            listenPending();
+            waitForEvents(connection_->socket(), -1);
+            connection_->consumeInput();
+        } catch (EnigmaException & e) {
+            LOG(ERROR) << "Result cache listener: " << e.what();
+            cache_->deactivateTags();
+            continue;
+        }
+
+        for (auto const & channel : connection_->notifies()) {
+            cache_->invalidateTag(channel);
+        }
+    }
+}
+
+bool ResultCacheListener::connect() {
+    try {
+        if (!connection_) {
+            connection_.reset(new Pgsql::ConnectionResource(options_, Pgsql::ConnectionInit::InitSync));
+        } else {
+            connection_->reset();
+        }
+    } catch (EnigmaException & e) {
+        LOG(ERROR) << "Failed to open result cache listener connection: " << e.what();
+        connection_.reset();
+        return false;
+    }
+
+    return connection_->status() == Pgsql::ConnectionResource::Status::Ok;
+}
+
+void ResultCacheListener::listenPending() {
+    std::vector<std::string> pending;
+    {
+        Lock l(lock_);
+        pending.swap(pendingChannels_);
+    }
+
+    for (auto const & channel : pending) {
+        auto result = connection_->execute("LISTEN " + quoteIdentifier(channel));
+        if (result->status() == Pgsql::ResultResource::Status::CommandOk) {
+            cache_->activateTag(channel);
+        } else {
+            LOG(ERROR) << "Failed to listen on result cache channel " << channel << ": "
+                       << result->errorMessage();
+        }
+    }
+}
+
+void ResultCacheListener::waitForEvents(int socket, int timeout) {
+    struct pollfd fds[2];
+    fds[0].fd = wakeupPipe_[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = socket;
+    fds[1].events = POLLIN;
+    poll(fds, socket != -1 ? 2 : 1, timeout);
+
+    // Drain the wakeup pipe
+    char buf[64];
+    while (read(wakeupPipe_[0], buf, sizeof(buf)) > 0) {}
+}
+
+void ResultCacheListener::wakeup() {
+    char c = 0;
+    if (write(wakeupPipe_[1], &c, 1) < 0) {
+        // The pipe is full, so the listener thread will wake up anyway
+    }
+}
+
+}
+}
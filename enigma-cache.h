@@ -0,0 +1,258 @@
+#ifndef HPHP_ENIGMA_CACHE_H
+#define HPHP_ENIGMA_CACHE_H
+
+#include "hphp/runtime/ext/extension.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <folly/EvictingCacheMap.h>
+#include "enigma-common.h"
+#include "enigma-plan.h"
+#include "pgsql-connection.h"
+#include "pgsql-result.h"
+
+namespace HPHP {
+namespace Enigma {
+
+struct QueryAwait;
+
+/*
+ * Where the result of a query should be stored in the result cache.
+ * Queries with an empty key are not cached.
+ */
+struct ResultCacheRequest {
+    std::string key;
+    // Number of seconds the result is served from the cache
+    unsigned ttl{0};
+    // Notification channels that invalidate the result
+    std::vector<std::string> tags;
+    // Invalidation counter of each tag when the query was started
+    std::vector<uint64_t> tagGenerations;
+
+    inline bool enabled() const {
+        return !key.empty();
+    }
+};
+
+/*
+ * Pool-wide cache of query results, keyed by the rewritten command and the encoded parameters.
+ * Results are kept as libpq result objects outside of request memory, and a copy is
+ * handed out on each hit.
+ */
+class ResultCache {
+public:
+    const static size_t DefaultMaxMemory = 16 * 1024 * 1024;
+    const static size_t MaxMemory = 1024 * 1024 * 1024;
+    const static unsigned MaxEntries = 100000;
+    const static unsigned MaxTtl = 86400;
+
+    ResultCache();
+
+    ResultCache(ResultCache const &) = delete;
+    ResultCache & operator = (ResultCache const &) = delete;
+
+    void setMaxMemory(size_t maxMemory);
+
+    static std::string makeKey(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                               unsigned flags);
+
+    /*
+     * Returns a copy of the cached result, or nullptr if the result isn't cached or has expired.
+     */
+    Pgsql::p_ResultResource lookup(std::string const & key);
+
+    /*
+     * Caches the result of a successful row-returning command.
+     * Other results (errors, DML without RETURNING, COPY) are ignored.
+     * Tagged results are only stored if none of their tags were invalidated since
+     * the query was started, and notifications on all tags are being listened to.
+     */
+    void store(ResultCacheRequest const & request, Pgsql::ResultResource const & result);
+
+    void clear();
+
+    /*
+     * Records the current invalidation counter of the tags of the request.
+     * Must be called before the query is sent to the server.
+     */
+    void snapshotTags(ResultCacheRequest & request);
+
+    /*
+     * Starts tracking invalidations of the tag; called once its notification channel is being listened to.
+     */
+    void activateTag(std::string const & tag);
+
+    /*
+     * Drops all results tagged with the tag.
+     */
+    void invalidateTag(std::string const & tag);
+
+    /*
+     * Drops all tagged results and stops tracking their tags.
+     * Used when notifications may have been missed (eg. the listener connection was lost).
+     */
+    void deactivateTags();
+
+    inline size_t memoryUsage() const {
+        return memoryUsage_;
+    }
+
+private:
+    struct Entry {
+        Entry(PGresult * r, std::shared_ptr<std::string const> tz,
+              std::chrono::steady_clock::time_point exp, size_t size, std::vector<std::string> t);
+        ~Entry();
+
+        Entry(Entry const &) = delete;
+        Entry & operator = (Entry const &) = delete;
+
+        PGresult * result;
+        std::shared_ptr<std::string const> serverTimezone;
+        std::chrono::steady_clock::time_point expires;
+        size_t memoryUsage;
+        std::vector<std::string> tags;
+    };
+
+    typedef std::shared_ptr<Entry const> sp_Entry;
+
+    Mutex lock_;
+    size_t maxMemory_{ DefaultMaxMemory };
+    size_t memoryUsage_{ 0 };
+    // Last invalidation counter value assigned to a tag
+    uint64_t lastTagGeneration_{ 0 };
+    // Invalidation counter of each tracked tag
+    std::unordered_map<std::string, uint64_t> tagGenerations_;
+    // Keys of the cached results of each tag
+    std::unordered_map<std::string, std::unordered_set<std::string>> taggedKeys_;
+    // Must be destroyed first, as the prune hook updates memoryUsage_ and taggedKeys_
+    folly::EvictingCacheMap<std::string, sp_Entry> entries_;
+
+    void entryEvicted(std::string const & key, Entry const & entry);
+    void removeEntry(std::string const & key);
+};
+
+typedef std::shared_ptr<ResultCache> sp_ResultCache;
+
+/*
+ * Results of the SELECT queries executed on a pool handle during the current request.
+ * Only accessed from the request thread, so no locking is done.
+ */
+class QueryMemo {
+public:
+    const static unsigned MaxResults = 256;
+
+    QueryMemo() = default;
+
+    QueryMemo(QueryMemo const &) = delete;
+    QueryMemo & operator = (QueryMemo const &) = delete;
+
+    /*
+     * Returns a copy of the memoized result, or nullptr if the query wasn't executed yet.
+     */
+    Pgsql::p_ResultResource lookup(std::string const & key) const;
+
+    /*
+     * Memoizes the result of a successful row-returning query, unless the memo was
+     * invalidated since the query was started (generation differs).
+     */
+    void store(std::string const & key, unsigned generation, Pgsql::ResultResource const & result);
+
+    /*
+     * Drops all memoized results; called when the handle executes a statement that may modify data.
+     */
+    void invalidate();
+
+    /*
+     * Incremented each time the memo is invalidated
+     */
+    inline unsigned generation() const {
+        return generation_;
+    }
+
+private:
+    unsigned generation_{ 0 };
+    std::unordered_map<std::string, Pgsql::p_ResultResource> results_;
+};
+
+typedef std::shared_ptr<QueryMemo> sp_QueryMemo;
+
+/*
+ * Identical queries being executed on the pool, keyed the same way as the result cache.
+ * Queries that arrive while an identical query is running wait for the result of the
+ * running query instead of being executed.
+ */
+class InflightQueries {
+public:
+    InflightQueries() = default;
+
+    InflightQueries(InflightQueries const &) = delete;
+    InflightQueries & operator = (InflightQueries const &) = delete;
+
+    /*
+     * Returns an event that completes with the result of the identical running query.
+     * If no such query is running, the query is registered as running and nullptr is returned;
+     * the caller must execute the query and call complete() when it finishes.
+     */
+    QueryAwait * follow(std::string const & key);
+
+    /*
+     * Completes the queries waiting for the result of the query with a copy of the result.
+     */
+    void complete(std::string const & key, bool succeeded, Pgsql::ResultResource const * result,
+                  std::string const & errorInfo);
+
+private:
+    Mutex lock_;
+    // Events waiting for the result of each running query
+    std::unordered_map<std::string, std::vector<QueryAwait *>> followers_;
+};
+
+/*
+ * Background connection that listens for notifications on the tags of cached results,
+ * and drops the results of a tag when a notification arrives on the channel of the same name.
+ */
+class ResultCacheListener {
+public:
+    // Milliseconds between reconnection attempts after the connection was lost
+    const static int ReconnectInterval = 1000;
+
+    ResultCacheListener(Pgsql::ConnectionOptions const & options, sp_ResultCache cache);
+    ~ResultCacheListener();
+
+    ResultCacheListener(ResultCacheListener const &) = delete;
+    ResultCacheListener & operator = (ResultCacheListener const &) = delete;
+
+    /*
+     * Starts listening on the channels that aren't listened to yet.
+     * The listener thread is started on first use; it opens the connection and
+     * retries every ReconnectInterval milliseconds while the server is unreachable.
+     */
+    void listen(std::vector<std::string> const & channels);
+
+private:
+    Pgsql::ConnectionOptions options_;
+    sp_ResultCache cache_;
+    Mutex lock_;
+    // Channels requested so far, and the ones we haven't sent a LISTEN for yet
+    std::unordered_set<std::string> channels_;
+    std::vector<std::string> pendingChannels_;
+    // Only accessed from the listener thread
+    std::unique_ptr<Pgsql::ConnectionResource> connection_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{ false };
+    // Used for waking up the listener thread when channels are added or the listener is stopped
+    int wakeupPipe_[2]{ -1, -1 };
+
+    void run();
+    bool connect();
+    void listenPending();
+    void waitForEvents(int socket, int timeout);
+    void wakeup();
+};
+
+}
+}
+
+#endif //HPHP_ENIGMA_CACHE_H
@@ -1,7 +1,12 @@
 #include <hphp/util/conv-10.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <strings.h>
 #include "enigma-queue.h"
 #include "enigma-transaction.h"
 #include "hphp/runtime/vm/native-data.h"
+#include "pgsql-parse.h"
 
 namespace HPHP {
 namespace Enigma {
@@ -12,26 +17,36 @@ PlanInfo::PlanInfo(std::string const & cmd)
     determineParameterType();
 }
 
-Array PlanInfo::mapParameters(Array const & params) const {
+ParameterKeys PlanInfo::parameterKeys() const {
+    ParameterKeys keys;
+    keys.reserve(parameterNameMap.size());
+    for (auto const & name : parameterNameMap) {
+        keys.push_back(String(name));
+    }
+
+    return keys;
+}
+
+Array PlanInfo::mapParameters(Array const & params, ParameterKeys const & keys) const {
     if (type == ParameterType::Named) {
-        return mapNamedParameters(params);
+        return mapNamedParameters(params, keys);
     } else {
         return mapNumberedParameters(params);
     }
 }
 
-Array PlanInfo::mapNamedParameters(Array const & params) const {
+Array PlanInfo::mapNamedParameters(Array const & params, ParameterKeys const & keys) const {
     if (parameterNameMap.size() != params.size()) {
         throw Exception(std::string("Parameter count mismatch; expected ") + std::to_string(parameterNameMap.size())
                         + " named parameters, got " + std::to_string(params.size()));
     }
 
-    Array mapped{Array::Create()};
-    for (unsigned i = 0; i < parameterNameMap.size(); i++) {
-        auto key = String(parameterNameMap[i]);
-        auto value = params->nvGet(key.get());
+    always_assert(keys.size() == parameterNameMap.size());
+    Array mapped{Array::attach(PackedArray::MakeReserve(keys.size()))};
+    for (unsigned i = 0; i < keys.size(); i++) {
+        auto value = params->nvGet(keys[i].get());
         if (value == nullptr) {
-            throw EnigmaException(std::string("Missing bound parameter: ") + key.c_str());
+            throw EnigmaException(std::string("Missing bound parameter: ") + parameterNameMap[i]);
         }
 
         mapped.append(*reinterpret_cast<Variant const *>(value));
@@ -59,29 +74,7 @@ Array PlanInfo::mapNumberedParameters(Array const & params) const {
     return mapped;
 }
 
-void PlanInfo::determineParameterType() {
-    auto numbered = parseNumberedParameters();
-    auto named = parseNamedParameters();
-
-    if (std::get<1>(named).size() > 0 && std::get<1>(numbered) > 0) {
-        throw Exception("Query contains both named and numbered parameters");
-    }
-
-    if (std::get<1>(named).size() > 0) {
-        type = ParameterType::Named;
-        rewrittenCommand = std::move(std::get<0>(named));
-        parameterNameMap = std::move(std::get<1>(named));
-        parameterCount = parameterNameMap.size();
-    } else {
-        type = ParameterType::Numbered;
-        rewrittenCommand = std::move(std::get<0>(numbered));
-        parameterCount = std::get<1>(numbered);
-    }
-}
-
-inline bool is_space(char c) {
-    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
-}
+namespace {
 
 inline bool is_alnum(char c) {
     return (c >= '0' && c <= '9')
@@ -93,159 +86,263 @@ inline bool is_placeholder_char(char c) {
     return is_alnum(c) || c == '_';
 }
 
-inline bool PlanInfo::isValidPlaceholder(std::size_t pos) const {
-    // Check if the preceding byte is in [0-9a-zA-Z (\r\n\t]
-    if (pos != 0) {
-        char prev = command[pos - 1];
-        if (
-                !is_space(prev)
-                && !is_alnum(prev)
-                && prev != '('
-                && prev != ']'
-                && prev != ','
-                ) {
-            return false;
+/*
+ * Characters that can be part of an identifier or keyword
+ * (non-ASCII characters are allowed in identifiers by PostgreSQL)
+ */
+inline bool is_identifier_char(char c) {
+    return is_placeholder_char(c) || c == '$' || (unsigned char)c >= 0x80;
+}
+
+inline bool is_identifier_start(char c) {
+    return (c >= 'a' && c <= 'z')
+           || (c >= 'A' && c <= 'Z')
+           || c == '_'
+           || (unsigned char)c >= 0x80;
+}
+
+/*
+ * Characters that need to be inspected by the placeholder lexer;
+ * runs of all other characters are copied to the rewritten command as-is.
+ */
+struct LexerCharTable {
+    bool special[256];
+
+    LexerCharTable() : special() {
+        for (auto c : {'\'', '"', '-', '/', '$', '?', ':'}) {
+            special[(unsigned char)c] = true;
         }
     }
-
-    // Check if the following byte is in [0-9a-zA-Z:) \r\n\t]
-    // Allow ":", as parameter typecasting is fairly common
-    if (pos < command.length() - 1) {
-        char next = command[pos + 1];
-        if (
-                !is_space(next)
-                && !is_alnum(next)
-                && next != ':'
-                && next != ')'
-                && next != ']'
-                && next != ','
-                ) {
-            return false;
+};
+
+const LexerCharTable s_lexerChars;
+
+/*
+ * Returns the position after the end of a string literal starting at pos.
+ * Backslash escapes are only processed in escape string constants (E'...').
+ */
+std::size_t skipStringLiteral(std::string const & sql, std::size_t pos) {
+    bool escapes = pos > 0 && (sql[pos - 1] == 'E' || sql[pos - 1] == 'e')
+                   && (pos == 1 || !is_identifier_char(sql[pos - 2]));
+    for (pos++; pos < sql.length(); pos++) {
+        if (escapes && sql[pos] == '\\') {
+            pos++;
+        } else if (sql[pos] == '\'') {
+            // Quotes inside the literal are escaped by doubling them
+            if (pos + 1 < sql.length() && sql[pos + 1] == '\'') {
+                pos++;
+            } else {
+                return pos + 1;
+            }
         }
     }
 
-    return true;
+    return sql.length();
 }
 
-inline bool PlanInfo::isValidNamedPlaceholder(std::size_t pos) const {
-    // Check if the preceding byte is in [ \r\n\t]
-    if (pos != 0) {
-        char prev = command[pos - 1];
-        if (
-                !is_space(prev)
-                && prev != '('
-                && prev != '['
-                && prev != ','
-                ) {
-            return false;
+/*
+ * Returns the position after the end of a quoted identifier starting at pos.
+ */
+std::size_t skipQuotedIdentifier(std::string const & sql, std::size_t pos) {
+    for (;;) {
+        pos = sql.find('"', pos + 1);
+        if (pos == std::string::npos) {
+            return sql.length();
+        }
+
+        if (pos + 1 < sql.length() && sql[pos + 1] == '"') {
+            pos++;
+        } else {
+            return pos + 1;
         }
     }
+}
 
-    // Check if the following byte is in [0-9a-zA-Z_]
-    if (
-            pos < command.length() - 1
-            && !is_placeholder_char(command[pos + 1])
-            ) {
-        return false;
+/*
+ * Returns the position after the end of a (possibly nested) block comment starting at pos.
+ */
+std::size_t skipBlockComment(std::string const & sql, std::size_t pos) {
+    unsigned depth = 0;
+    while (pos + 1 < sql.length()) {
+        if (sql[pos] == '/' && sql[pos + 1] == '*') {
+            depth++;
+            pos += 2;
+        } else if (sql[pos] == '*' && sql[pos + 1] == '/') {
+            pos += 2;
+            if (--depth == 0) {
+                return pos;
+            }
+        } else {
+            pos++;
+        }
     }
 
-    return true;
+    return sql.length();
 }
 
-inline std::size_t PlanInfo::namedPlaceholderLength(std::size_t pos) const {
-    if (!isValidNamedPlaceholder(pos)) {
-        return 0;
+/*
+ * Returns the position after the end of a dollar-quoted string ($tag$...$tag$) starting at pos,
+ * or pos + 1 if the dollar sign doesn't start a dollar-quoted string.
+ */
+std::size_t skipDollarQuotedString(std::string const & sql, std::size_t pos) {
+    // "$" can also be part of an identifier or a positional parameter ($1)
+    if (pos > 0 && is_identifier_char(sql[pos - 1])) {
+        return pos + 1;
+    }
+
+    auto tagEnd = pos + 1;
+    if (tagEnd < sql.length() && is_identifier_start(sql[tagEnd])) {
+        for (tagEnd++; tagEnd < sql.length() && is_identifier_char(sql[tagEnd]) && sql[tagEnd] != '$'; tagEnd++);
     }
 
-    auto i = pos + 1;
-    for (; i < command.length() && (is_alnum(command[i]) || command[i] == '_'); i++);
+    if (tagEnd >= sql.length() || sql[tagEnd] != '$') {
+        return pos + 1;
+    }
 
-    return i - pos - 1;
+    auto tagLength = tagEnd - pos + 1;
+    auto end = sql.find(sql.data() + pos, tagEnd + 1, tagLength);
+    return end == std::string::npos ? sql.length() : end + tagLength;
 }
 
-std::tuple<std::string, unsigned> __attribute__ ((noinline)) PlanInfo::parseNumberedParameters() const {
-    unsigned numParams{0};
-    std::string rewritten;
-    rewritten.reserve(command.size() + (command.size() >> 1));
+inline void appendParameterNumber(std::string & rewritten, unsigned number) {
+    char paramNo[21];
+    paramNo[0] = '\0';
+    auto paramNoStr = conv_10(number, &paramNo[20]);
+    rewritten.push_back('$');
+    rewritten.append(paramNoStr.start(), paramNoStr.size());
+}
 
-    // Check if the placeholder is valid
-    // (should only be preceded and followed by [0-9a-z] and whitespace)
-    std::size_t pos{0}, lastWrittenPos{0};
-    for (;;) {
-        pos = command.find('?', pos);
-        if (pos == std::string::npos) {
-            break;
-        }
+}
 
-        rewritten.append(command.data() + lastWrittenPos, pos - lastWrittenPos);
-        lastWrittenPos = pos + 1;
+/*
+ * Only checks the leading keyword; SELECTs calling functions that modify data
+ * and data-modifying CTEs (WITH ... INSERT) are not detected.
+ */
+bool PlanInfo::isSelect() const {
+    auto start = rewrittenCommand.find_first_not_of(" \t\r\n(");
+    if (start == std::string::npos) {
+        return false;
+    }
 
-        if (isValidPlaceholder(pos++)) {
-            char paramNo[21];
-            paramNo[0] = '\0';
-            auto paramNoStr = conv_10(++numParams, &paramNo[20]);
-            rewritten.push_back('$');
-            rewritten.append(paramNoStr.start(), paramNoStr.size());
-        } else {
-            rewritten.push_back('?');
+    static char const * const readKeywords[] = {"select", "values", "table"};
+    for (auto keyword : readKeywords) {
+        auto length = strlen(keyword);
+        if (strncasecmp(rewrittenCommand.c_str() + start, keyword, length) == 0
+            && !is_identifier_char(rewrittenCommand[start + length])) {
+            return true;
         }
     }
 
-    rewritten.append(command.data() + lastWrittenPos, command.length() - lastWrittenPos);
-    return std::make_tuple(rewritten, numParams);
+    return false;
 }
 
-std::tuple<std::string, std::vector<std::string> > PlanInfo::parseNamedParameters() const {
-    std::vector<std::string> params;
-    std::unordered_map<std::string, unsigned> paramMap;
-    std::string rewritten;
-    rewritten.reserve(command.size() + (command.size() >> 1));
+/*
+ * Rewrites "?" and ":name" placeholders to "$n" in a single pass over the command.
+ * String literals, quoted identifiers, comments and dollar-quoted strings are skipped,
+ * as are "::" typecasts and the "?|", "?&", "?#", "?-" operators.
+ */
+void PlanInfo::determineParameterType() {
+    std::unordered_map<std::string, unsigned> namedParameters;
+    unsigned numberedParameters{0};
+    rewrittenCommand.reserve(command.size() + (command.size() >> 3));
 
+    auto length = command.length();
     std::size_t pos{0}, lastWrittenPos{0};
-    for (;;) {
-        pos = command.find(':', pos);
-        if (pos == std::string::npos) {
-            break;
+    while (pos < length) {
+        if (!s_lexerChars.special[(unsigned char)command[pos]]) {
+            pos++;
+            continue;
         }
 
-        rewritten.append(command.data() + lastWrittenPos, pos - lastWrittenPos);
-        lastWrittenPos = pos + 1;
+        char next = pos + 1 < length ? command[pos + 1] : '\0';
+        switch (command[pos]) {
+            case '\'':
+                pos = skipStringLiteral(command, pos);
+                break;
+
+            case '"':
+                pos = skipQuotedIdentifier(command, pos);
+                break;
+
+            case '-':
+                if (next == '-') {
+                    pos = command.find('\n', pos);
+                    pos = (pos == std::string::npos) ? length : pos + 1;
+                } else {
+                    pos++;
+                }
+                break;
+
+            case '/':
+                pos = (next == '*') ? skipBlockComment(command, pos) : pos + 1;
+                break;
+
+            case '$':
+                pos = skipDollarQuotedString(command, pos);
+                break;
+
+            case '?':
+                if (next == '|' || next == '&' || next == '#' || next == '-' || next == '?') {
+                    pos += 2;
+                } else {
+                    rewrittenCommand.append(command.data() + lastWrittenPos, pos - lastWrittenPos);
+                    appendParameterNumber(rewrittenCommand, ++numberedParameters);
+                    lastWrittenPos = ++pos;
+                }
+                break;
+
+            case ':':
+                if (next == ':') {
+                    pos += 2;
+                } else if (is_placeholder_char(next)
+                           && (pos == 0 || (!is_identifier_char(command[pos - 1])
+                                            && command[pos - 1] != ']' && command[pos - 1] != ')'))) {
+                    auto nameEnd = pos + 2;
+                    for (; nameEnd < length && is_placeholder_char(command[nameEnd]); nameEnd++);
+
+                    std::string name(command.data() + pos + 1, nameEnd - pos - 1);
+                    auto it = namedParameters.find(name);
+                    unsigned number;
+                    if (it != namedParameters.end()) {
+                        number = it->second;
+                    } else {
+                        parameterNameMap.push_back(name);
+                        number = parameterNameMap.size();
+                        namedParameters.insert(std::make_pair(std::move(name), number));
+                    }
+
+                    rewrittenCommand.append(command.data() + lastWrittenPos, pos - lastWrittenPos);
+                    appendParameterNumber(rewrittenCommand, number);
+                    pos = lastWrittenPos = nameEnd;
+                } else {
+                    pos++;
+                }
+                break;
+        }
+    }
 
-        auto placeholderLength = namedPlaceholderLength(pos++);
-        if (placeholderLength > 0) {
-            std::string param = command.substr(pos, placeholderLength);
-            auto paramIt = paramMap.find(param);
-            if (paramIt != paramMap.end()) {
-                char paramNo[21];
-                paramNo[0] = '\0';
-                auto paramNoStr = conv_10(paramIt->second, &paramNo[20]);
-                rewritten.push_back('$');
-                rewritten.append(paramNoStr.start(), paramNoStr.size());
-            } else {
-                params.push_back(param);
-                paramMap.insert(std::make_pair(param, params.size()));
-
-                char paramNo[21];
-                paramNo[0] = '\0';
-                auto paramNoStr = conv_10(params.size(), &paramNo[20]);
-                rewritten.push_back('$');
-                rewritten.append(paramNoStr.start(), paramNoStr.size());
-            }
+    rewrittenCommand.append(command.data() + lastWrittenPos, length - lastWrittenPos);
 
-            pos += placeholderLength;
-            lastWrittenPos += placeholderLength;
-        } else {
-            rewritten.push_back(':');
-        }
+    if (!parameterNameMap.empty() && numberedParameters > 0) {
+        throw Exception("Query contains both named and numbered parameters");
     }
 
-    rewritten.append(command.data() + lastWrittenPos, command.length() - lastWrittenPos);
-    return std::make_tuple(rewritten, std::move(params));
+    if (!parameterNameMap.empty()) {
+        type = ParameterType::Named;
+        parameterCount = parameterNameMap.size();
+    } else {
+        type = ParameterType::Numbered;
+        parameterCount = numberedParameters;
+    }
 }
 
-PlanCache::PlanCache(unsigned size)
-        : plans_(size)
-{}
+PlanCache::PlanCache(unsigned size, size_t maxMemory)
+        : maxMemory_(maxMemory), plans_(size)
+{
+    plans_.setPruneHook([this] (std::string, p_CachedPlan && plan) {
+        planEvicted(*plan);
+    });
+}
 
 PlanCache::CachedPlan::CachedPlan(std::string const & cmd)
         : planInfo(cmd)
@@ -254,36 +351,573 @@ PlanCache::CachedPlan::CachedPlan(std::string const & cmd)
 PlanCache::CachedPlan const * PlanCache::lookupPlan(std::string const & query) {
     auto it = plans_.find(query);
     if (it != plans_.end()) {
+        it->second->hits++;
+        if (it->second->registration) {
+            it->second->registration->hits.fetch_add(1, std::memory_order_relaxed);
+        }
         return it->second.get();
     } else {
         return nullptr;
     }
 }
 
-PlanCache::CachedPlan const * PlanCache::assignPlan(std::string const & query) {
+PlanCache::CachedPlan * PlanCache::assignPlan(std::string const & query) {
     auto name = generatePlanName();
     return storePlan(query, name);
 }
 
 void PlanCache::forgetPlan(std::string const & query) {
-    plans_.erase(query);
+    // Only called if the statement couldn't be prepared, so there is nothing to deallocate
+    auto it = plans_.find(query);
+    if (it != plans_.end()) {
+        memoryUsage_ -= estimateMemoryUsage(it->second->planInfo.rewrittenCommand);
+        plans_.erase(it);
+    }
 }
 
-PlanCache::CachedPlan const * PlanCache::storePlan(std::string const & query, std::string const & statementName) {
+PlanCache::CachedPlan * PlanCache::storePlan(std::string const & query, std::string const & statementName) {
     auto plan = p_CachedPlan(new CachedPlan(query));
     auto planPtr = plan.get();
     plan->statementName = statementName;
+
+    auto existing = plans_.find(query);
+    if (existing != plans_.end()) {
+        planEvicted(*existing->second);
+        plans_.erase(existing);
+    }
+
+    memoryUsage_ += estimateMemoryUsage(plan->planInfo.rewrittenCommand);
     plans_.set(query, std::move(plan));
+
+    // Evict least recently used plans until we're within the memory budget
+    while (maxMemory_ > 0 && memoryUsage_ > maxMemory_ && plans_.size() > 1) {
+        plans_.prune(1);
+    }
+
     return planPtr;
 }
 
+void PlanCache::planEvicted(CachedPlan const & plan) {
+    memoryUsage_ -= estimateMemoryUsage(plan.planInfo.rewrittenCommand);
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+    auto const & query = plan.planInfo.command;
+    // Plans in the PREPARE command that is being executed may or may not be prepared
+    bool preparing = std::find(preparingPlans_.begin(), preparingPlans_.end(), query) != preparingPlans_.end();
+    if (plan.prepared || preparing) {
+        evictedStatements_.push_back(plan.statementName);
+    } else {
+        // The statement was never sent to the server, so there is nothing to deallocate
+        unpreparedPlans_.erase(std::remove(unpreparedPlans_.begin(), unpreparedPlans_.end(), query),
+                unpreparedPlans_.end());
+    }
+}
+
 void PlanCache::clear() {
     plans_.clear();
+    // Statements are dropped by the server when the connection is closed
+    evictedStatements_.clear();
+    deallocatingStatements_.clear();
+    unpreparedPlans_.clear();
+    preparingPlans_.clear();
+    undescribedPlans_.clear();
+    describingPlan_.clear();
+    warmedGeneration_ = ~0u;
+    failedRegistrations_.clear();
+    memoryUsage_ = 0;
+}
+
+sp_PlanDescription PlanDescription::fromResult(Pgsql::ResultResource const & result) {
+    auto description = std::make_shared<PlanDescription>();
+    auto numParams = result.numParams();
+    description->parameterTypes.reserve(numParams);
+    for (int i = 0; i < numParams; i++) {
+        description->parameterTypes.push_back(result.paramType(i));
+    }
+
+    auto numFields = result.numFields();
+    description->resultTypes.reserve(numFields);
+    description->binaryResults = numFields > 0;
+    for (int i = 0; i < numFields; i++) {
+        auto type = result.columnType(i);
+        description->resultTypes.push_back(type);
+        if (!Pgsql::isBinaryTransparentType(type)) {
+            description->binaryResults = false;
+        }
+    }
+
+    return description;
+}
+
+void PlanCache::connectionReset() {
+    std::vector<std::pair<unsigned, std::string>> hotPlans;
+    std::vector<std::string> coldPlans;
+    for (auto const & plan : plans_) {
+        plan.second->prepared = false;
+        // Plans that weren't prepared yet are kept as well, as they're expected to be used soon
+        bool unprepared = std::find(unpreparedPlans_.begin(), unpreparedPlans_.end(), plan.first)
+                != unpreparedPlans_.end();
+        if ((plan.second->hits > 0 || unprepared) && isRestorable(*plan.second)) {
+            hotPlans.emplace_back(plan.second->hits, plan.first);
+        } else {
+            coldPlans.push_back(plan.first);
+        }
+    }
+
+    if (hotPlans.size() > MaxRestoredPlans) {
+        std::partial_sort(hotPlans.begin(), hotPlans.begin() + MaxRestoredPlans, hotPlans.end(),
+            [] (std::pair<unsigned, std::string> const & a, std::pair<unsigned, std::string> const & b) {
+                return a.first > b.first;
+            });
+
+        for (auto it = hotPlans.begin() + MaxRestoredPlans; it != hotPlans.end(); ++it) {
+            coldPlans.push_back(std::move(it->second));
+        }
+
+        hotPlans.resize(MaxRestoredPlans);
+    }
+
+    for (auto const & query : coldPlans) {
+        forgetPlan(query);
+    }
+
+    // Statements are dropped by the server when the connection is closed
+    evictedStatements_.clear();
+    deallocatingStatements_.clear();
+    preparingPlans_.clear();
+    unpreparedPlans_.clear();
+    undescribedPlans_.clear();
+    describingPlan_.clear();
+    warmedGeneration_ = ~0u;
+    // Plans may succeed on the new connection, e.g. if they failed because of a temporary table
+    failedRegistrations_.clear();
+    for (auto & plan : hotPlans) {
+        unpreparedPlans_.push_back(std::move(plan.second));
+    }
+}
+
+namespace {
+
+/*
+ * Type names of parameter OIDs that can be used in a PREPARE statement.
+ * (Only types that are generated by PreparedParameters need to be handled)
+ */
+char const * preparedTypeName(Oid type) {
+    switch (type) {
+        case 0: return "unknown";
+        case Pgsql::kOidBool: return "bool";
+        case Pgsql::kOidBytea: return "bytea";
+        case Pgsql::kOidInt8: return "int8";
+        case Pgsql::kOidText: return "text";
+        case Pgsql::kOidFloat8: return "float8";
+        case Pgsql::kOidBoolArray: return "bool[]";
+        case Pgsql::kOidTextArray: return "text[]";
+        case Pgsql::kOidInt8Array: return "int8[]";
+        case Pgsql::kOidFloat8Array: return "float8[]";
+        default: return nullptr;
+    }
+}
+
+}
+
+bool PlanCache::isRestorable(CachedPlan const & plan) {
+    for (auto type : plan.parameterTypes) {
+        if (preparedTypeName(type) == nullptr) {
+            return false;
+        }
+    }
+
+    /*
+     * The PREPARE statement only accepts SELECT, INSERT, UPDATE, DELETE and VALUES commands,
+     * while the extended query protocol can prepare any command.
+     */
+    auto const & command = plan.planInfo.rewrittenCommand;
+    auto start = command.find_first_not_of(" \t\r\n(");
+    if (start == std::string::npos) {
+        return false;
+    }
+
+    static char const * const preparableKeywords[] = {"select", "insert", "update", "delete", "values", "with"};
+    for (auto keyword : preparableKeywords) {
+        auto length = strlen(keyword);
+        if (strncasecmp(command.c_str() + start, keyword, length) == 0
+            && !is_identifier_char(command[start + length])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string PlanCache::takePrepareCommand() {
+    std::string command;
+    preparingPlans_.clear();
+    for (auto const & query : unpreparedPlans_) {
+        auto it = plans_.find(query);
+        if (it == plans_.end()) {
+            continue;
+        }
+
+        auto const & plan = *it->second;
+        command += "PREPARE \"";
+        command += plan.statementName;
+        command += "\"";
+        if (!plan.parameterTypes.empty()) {
+            command += " (";
+            for (size_t i = 0; i < plan.parameterTypes.size(); i++) {
+                if (i > 0) {
+                    command += ", ";
+                }
+                command += preparedTypeName(plan.parameterTypes[i]);
+            }
+            command += ")";
+        }
+
+        command += " AS ";
+        command += plan.planInfo.rewrittenCommand;
+        // Newline terminates trailing line comments in the command
+        command += "\n;";
+        preparingPlans_.push_back(query);
+    }
+
+    unpreparedPlans_.clear();
+    return command;
+}
+
+void PlanCache::warm(PlanRegistry const & registry) {
+    auto generation = registry.generation();
+    if (generation == warmedGeneration_) {
+        return;
+    }
+
+    warmedGeneration_ = generation;
+    std::vector<sp_RegisteredPlan> failedRegistrations;
+    for (auto const & plan : registry.plans()) {
+        if (std::find(failedRegistrations_.begin(), failedRegistrations_.end(), plan) != failedRegistrations_.end()) {
+            failedRegistrations.push_back(plan);
+            continue;
+        }
+
+        if (!plan->prepared.load(std::memory_order_acquire) || plans_.exists(plan->command)) {
+            continue;
+        }
+
+        // Plans used by this connection are more valuable than the plans of other connections
+        if (plans_.size() >= plans_.getMaxSize()
+            || (maxMemory_ > 0 && memoryUsage_ + estimateMemoryUsage(plan->command) > maxMemory_)) {
+            continue;
+        }
+
+        schedulePlan(plan);
+    }
+
+    // Failures of plans that were removed from the registry are no longer needed
+    failedRegistrations_ = std::move(failedRegistrations);
+}
+
+std::vector<sp_RegisteredPlan> PlanCache::takePreparedRegistrations() {
+    std::vector<sp_RegisteredPlan> registrations;
+    registrations.swap(preparedRegistrations_);
+    return registrations;
+}
+
+PlanCache::CachedPlan const * PlanCache::schedulePlan(sp_RegisteredPlan const & registration) {
+    auto const & query = registration->command;
+    auto plan = assignPlan(query);
+    plan->parameterTypes = registration->parameterTypes;
+    plan->registration = registration;
+    plan->description = registration->description();
+    if (!isRestorable(*plan)) {
+        forgetPlan(query);
+        return nullptr;
+    }
+
+    unpreparedPlans_.push_back(query);
+    return plan;
+}
+
+std::string PlanCache::plansPrepared(unsigned preparedCount) {
+    std::string failedStatement;
+    for (size_t i = 0; i < preparingPlans_.size(); i++) {
+        auto const & query = preparingPlans_[i];
+        auto it = plans_.find(query);
+        if (it == plans_.end()) {
+            continue;
+        }
+
+        auto const & registration = it->second->registration;
+        if (i < preparedCount) {
+            it->second->prepared = true;
+            if (registration && !registration->prepared.load(std::memory_order_acquire)) {
+                preparedRegistrations_.push_back(registration);
+            }
+        } else if (i == preparedCount) {
+            failedStatement = it->second->statementName;
+            if (registration) {
+                failedRegistrations_.push_back(registration);
+            }
+
+            forgetPlan(query);
+        } else if (i > preparedCount) {
+            unpreparedPlans_.push_back(query);
+        }
+    }
+
+    preparingPlans_.clear();
+    return failedStatement;
+}
+
+bool PlanCache::requestDescription(std::string const & query) {
+    auto it = plans_.find(query);
+    if (it == plans_.end() || it->second->description) {
+        return false;
+    }
+
+    auto & plan = *it->second;
+    if (plan.registration) {
+        plan.description = plan.registration->description();
+        if (plan.description) {
+            return false;
+        }
+    }
+
+    if (std::find(undescribedPlans_.begin(), undescribedPlans_.end(), query) == undescribedPlans_.end()) {
+        undescribedPlans_.push_back(query);
+    }
+
+    return true;
+}
+
+std::string PlanCache::takeUndescribedStatement() {
+    while (!undescribedPlans_.empty()) {
+        describingPlan_ = std::move(undescribedPlans_.back());
+        undescribedPlans_.pop_back();
+        auto it = plans_.find(describingPlan_);
+        if (it != plans_.end()) {
+            return it->second->statementName;
+        }
+    }
+
+    describingPlan_.clear();
+    return std::string();
+}
+
+void PlanCache::planDescribed(sp_PlanDescription const & description) {
+    describePlan(describingPlan_, description);
+    describingPlan_.clear();
+}
+
+void PlanCache::describePlan(std::string const & query, sp_PlanDescription const & description) {
+    auto it = plans_.find(query);
+    if (it != plans_.end() && description) {
+        it->second->description = description;
+        if (it->second->registration) {
+            it->second->registration->setDescription(description);
+        }
+    }
+}
+
+std::string PlanCache::takeDeallocationCommand() {
+    std::string command;
+    for (auto const & statementName : evictedStatements_) {
+        command += "DEALLOCATE \"";
+        command += statementName;
+        command += "\";";
+    }
+
+    deallocatingStatements_ = std::move(evictedStatements_);
+    evictedStatements_.clear();
+    return command;
+}
+
+void PlanCache::statementsDeallocated(unsigned deallocatedCount) {
+    for (size_t i = deallocatedCount + 1; i < deallocatingStatements_.size(); i++) {
+        evictedStatements_.push_back(std::move(deallocatingStatements_[i]));
+    }
+
+    deallocatingStatements_.clear();
+}
+
+size_t PlanCache::estimateMemoryUsage(std::string const & command) {
+    /*
+     * The backend keeps the raw query, the parse tree and the generic plan of each statement;
+     * their size is roughly proportional to the length of the query text.
+     */
+    static constexpr size_t StatementOverhead = 1024;
+    static constexpr size_t MemoryPerQueryByte = 16;
+    return StatementOverhead + command.size() * MemoryPerQueryByte;
 }
 
 std::string PlanCache::generatePlanName() {
     return PlanNamePrefix + std::to_string(nextPlanId_++);
 }
 
+
+RegisteredPlan::RegisteredPlan(std::string const & cmd, std::vector<Oid> const & types, unsigned initialHits)
+        : command(cmd), parameterTypes(types), hits(initialHits)
+{}
+
+PlanRegistry::PlanRegistry(unsigned size)
+        : plans_(size)
+{}
+
+void PlanRegistry::setSize(unsigned size) {
+    Lock l(lock_);
+    plans_.setMaxSize(size);
+}
+
+sp_RegisteredPlan PlanRegistry::registerPlan(std::string const & command, std::vector<Oid> const & parameterTypes) {
+    Lock l(lock_);
+    auto it = plans_.find(command);
+    if (it != plans_.end() && it->second->parameterTypes == parameterTypes) {
+        return it->second;
+    }
+
+    auto plan = std::make_shared<RegisteredPlan>(command, parameterTypes);
+    plans_.set(command, plan);
+    return plan;
+}
+
+void PlanRegistry::planPrepared(RegisteredPlan & plan) {
+    if (!plan.prepared.exchange(true, std::memory_order_acq_rel)) {
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+std::vector<sp_RegisteredPlan> PlanRegistry::plans() const {
+    Lock l(lock_);
+    std::vector<sp_RegisteredPlan> plans;
+    plans.reserve(plans_.size());
+    for (auto const & plan : plans_) {
+        plans.push_back(plan.second);
+    }
+
+    return plans;
+}
+
+/*
+ * File format:
+ *   enigma-plans 1
+ *   <hits> <parameter type count> <parameter type OIDs...> <command length>
+ *   <command>
+ *   ...
+ */
+bool PlanRegistry::save(std::string const & path, unsigned count) const {
+    auto plans = this->plans();
+    std::vector<std::pair<unsigned, RegisteredPlan const *>> hottest;
+    hottest.reserve(plans.size());
+    for (auto const & plan : plans) {
+        if (plan->prepared.load(std::memory_order_acquire)) {
+            hottest.emplace_back(plan->hits.load(std::memory_order_relaxed), plan.get());
+        }
+    }
+
+    std::sort(hottest.begin(), hottest.end(),
+        [] (std::pair<unsigned, RegisteredPlan const *> const & a,
+            std::pair<unsigned, RegisteredPlan const *> const & b) {
+            return a.first > b.first;
+        });
+    if (hottest.size() > count) {
+        hottest.resize(count);
+    }
+
+    // Write to a temporary file first, so readers never see a partially written file
+    auto tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+        file << FileHeader << "\n";
+        for (auto const & plan : hottest) {
+            file << plan.first << " " << plan.second->parameterTypes.size();
+            for (auto type : plan.second->parameterTypes) {
+                file << " " << type;
+            }
+
+            file << " " << plan.second->command.size() << "\n" << plan.second->command << "\n";
+        }
+
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+bool PlanRegistry::load(std::string const & path) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::string header;
+    if (!std::getline(file, header) || header != FileHeader) {
+        return false;
+    }
+
+    std::vector<sp_RegisteredPlan> loaded;
+    for (;;) {
+        unsigned hits;
+        size_t typeCount, commandLength;
+        if (!(file >> hits >> typeCount) || typeCount > 0xffff) {
+            break;
+        }
+
+        std::vector<Oid> types(typeCount);
+        for (auto & type : types) {
+            file >> type;
+        }
+
+        if (!(file >> commandLength) || file.get() != '\n' || commandLength > 0x1000000) {
+            return false;
+        }
+
+        std::string command(commandLength, '\0');
+        if (!file.read(&command[0], commandLength) || file.get() != '\n') {
+            return false;
+        }
+
+        // Halve the stored hit counts, so plans that are no longer used age out over restarts
+        loaded.push_back(std::make_shared<RegisteredPlan>(command, types, hits / 2));
+        // Only plans that were prepared successfully are saved
+        loaded.back()->prepared.store(true, std::memory_order_relaxed);
+    }
+
+    if (loaded.empty()) {
+        return false;
+    }
+
+    Lock l(lock_);
+    // Register the hottest plans last, so they're the last ones to be evicted
+    for (auto it = loaded.rbegin(); it != loaded.rend(); ++it) {
+        plans_.set((*it)->command, *it);
+    }
+
+    generation_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+
+PlanExecutionCounter::PlanExecutionCounter(unsigned threshold)
+        : threshold_(threshold), executions_(MaxTrackedCommands)
+{}
+
+void PlanExecutionCounter::setThreshold(unsigned threshold) {
+    threshold_ = threshold;
+}
+
+bool PlanExecutionCounter::recordExecution(std::string const & command) {
+    if (threshold_ <= 1) {
+        return true;
+    }
+
+    Lock l(lock_);
+    auto it = executions_.find(command);
+    if (it == executions_.end()) {
+        executions_.set(command, 1);
+        return false;
+    }
+
+    if (it->second < threshold_) {
+        it->second++;
+    }
+
+    return it->second >= threshold_;
+}
+
 }
 }
@@ -2,13 +2,23 @@
 #define HPHP_ENIGMA_PLAN_H
 
 #include "hphp/runtime/ext/extension.h"
+#include <atomic>
 #include <folly/EvictingCacheMap.h>
 #include "enigma-common.h"
+#include "pgsql-connection.h"
+#include "pgsql-result.h"
 
 namespace HPHP {
 namespace Enigma {
 
 
+/*
+ * Lookup keys of named parameters, in placeholder order.
+ * Strings cache their hash on first use, so each key is only hashed once per Query object.
+ * Keys are request-local and must not be stored in plans that outlive the request.
+ */
+typedef req::vector<String> ParameterKeys;
+
 struct PlanInfo {
     enum class ParameterType {
         /*
@@ -25,7 +35,13 @@ struct PlanInfo {
 
     PlanInfo(std::string const & cmd);
 
-    Array mapParameters(Array const & params) const;
+    ParameterKeys parameterKeys() const;
+    Array mapParameters(Array const & params, ParameterKeys const & keys) const;
+
+    /*
+     * Returns whether the command is a read-only SELECT, VALUES or TABLE statement.
+     */
+    bool isSelect() const;
 
     std::string command;
     std::string rewrittenCommand;
@@ -34,17 +50,55 @@ struct PlanInfo {
     unsigned parameterCount;
 
 private:
-    Array mapNamedParameters(Array const & params) const;
+    Array mapNamedParameters(Array const & params, ParameterKeys const & keys) const;
     Array mapNumberedParameters(Array const & params) const;
 
     void determineParameterType();
-    std::tuple<std::string, unsigned> parseNumberedParameters() const;
-    std::tuple<std::string, std::vector<std::string> > parseNamedParameters() const;
-    bool isValidPlaceholder(std::size_t pos) const;
-    bool isValidNamedPlaceholder(std::size_t pos) const;
-    std::size_t namedPlaceholderLength(std::size_t pos) const;
 };
 
+class PlanRegistry;
+
+/*
+ * Parameter and result column types of a prepared statement, as reported by the server
+ */
+struct PlanDescription {
+    static std::shared_ptr<PlanDescription const> fromResult(Pgsql::ResultResource const & result);
+
+    std::vector<Oid> parameterTypes;
+    std::vector<Oid> resultTypes;
+    // Whether results can be fetched using the binary protocol without changing the decoded values
+    bool binaryResults{false};
+};
+
+typedef std::shared_ptr<PlanDescription const> sp_PlanDescription;
+
+/*
+ * Statement prepared on a connection of the pool, shared by the plan caches of all connections
+ */
+struct RegisteredPlan {
+    RegisteredPlan(std::string const & cmd, std::vector<Oid> const & types, unsigned initialHits = 0);
+
+    std::string command;
+    std::vector<Oid> parameterTypes;
+    // Number of times the plan was reused on any connection
+    std::atomic<unsigned> hits;
+    // Whether the statement was prepared successfully on any connection
+    std::atomic<bool> prepared{false};
+
+    inline sp_PlanDescription description() const {
+        return std::atomic_load(&description_);
+    }
+
+    inline void setDescription(sp_PlanDescription const & description) {
+        std::atomic_store(&description_, description);
+    }
+
+private:
+    sp_PlanDescription description_;
+};
+
+typedef std::shared_ptr<RegisteredPlan> sp_RegisteredPlan;
+
 class PlanCache {
 public:
     struct CachedPlan {
@@ -52,34 +106,245 @@ public:
 
         std::string statementName;
         PlanInfo planInfo;
+        // Parameter types the statement was prepared with (empty if all types were inferred)
+        std::vector<Oid> parameterTypes;
+        // Number of times the plan was reused
+        unsigned hits{0};
+        // Whether the statement was prepared on the server
+        bool prepared{false};
+        // Pool-wide registration of the plan
+        sp_RegisteredPlan registration;
+        // Statement metadata (null if the statement wasn't described yet)
+        sp_PlanDescription description;
+
+        /*
+         * Parameter types to encode parameters for
+         */
+        inline std::vector<Oid> const & bindTypes() const {
+            return description ? description->parameterTypes : parameterTypes;
+        }
     };
 
     typedef std::unique_ptr<CachedPlan> p_CachedPlan;
     static const unsigned DefaultPlanCacheSize = 30;
     static const unsigned MaxPlanCacheSize = 1000;
+    // Upper bound for the plan cache memory budget (256 MB)
+    static const size_t MaxPlanCacheMemory = 256 * 1024 * 1024;
+    // Number of most frequently used plans that are prepared again after a reconnect
+    static const unsigned MaxRestoredPlans = 16;
 
-    PlanCache(unsigned size = DefaultPlanCacheSize);
+    PlanCache(unsigned size = DefaultPlanCacheSize, size_t maxMemory = 0);
 
     PlanCache(PlanCache const &) = delete;
     PlanCache & operator = (PlanCache const &) = delete;
 
     CachedPlan const * lookupPlan(std::string const & query);
-    CachedPlan const * assignPlan(std::string const & query);
+    CachedPlan * assignPlan(std::string const & query);
     void forgetPlan(std::string const & query);
     void clear();
 
+    /*
+     * Drops all plans after the connection was reset, except the most frequently used ones,
+     * which keep their statement names and are prepared again on the new connection.
+     */
+    void connectionReset();
+
+    inline bool hasUnpreparedPlans() const {
+        return !unpreparedPlans_.empty();
+    }
+
+    /*
+     * Returns a command that prepares all plans kept by connectionReset() in a single round trip.
+     */
+    std::string takePrepareCommand();
+
+    /*
+     * Processes the results of the command returned by takePrepareCommand().
+     * Statements are executed in order, so the first preparedCount statements succeeded,
+     * the next one failed (its plan is removed and its statement name is returned) and
+     * the remaining ones were skipped, so they're prepared by the next command.
+     */
+    std::string plansPrepared(unsigned preparedCount);
+
+    /*
+     * Adds a plan to the cache that is prepared by the next takePrepareCommand().
+     * Returns null if the plan can't be prepared that way.
+     */
+    CachedPlan const * schedulePlan(sp_RegisteredPlan const & registration);
+
+    /*
+     * Schedules describing the statement of a plan that has no description yet.
+     * (Descriptions found by other connections of the pool are reused)
+     * Returns false if the plan doesn't need to be described.
+     */
+    bool requestDescription(std::string const & query);
+
+    inline bool hasUndescribedPlans() const {
+        return !undescribedPlans_.empty();
+    }
+
+    /*
+     * Returns the name of a prepared statement that needs to be described.
+     * The description must be passed to planDescribed().
+     */
+    std::string takeUndescribedStatement();
+    void planDescribed(sp_PlanDescription const & description);
+    void describePlan(std::string const & query, sp_PlanDescription const & description);
+
+    /*
+     * Schedules the plans of the registry that are missing from this cache for preparation,
+     * as long as they fit into the cache without evicting other plans.
+     * Plans that failed to prepare on this connection are skipped.
+     * (The registry is only checked again after a new plan was prepared)
+     */
+    void warm(PlanRegistry const & registry);
+
+    /*
+     * Returns the registered plans that were prepared for the first time on this connection
+     * since the last call; they need to be passed to PlanRegistry::planPrepared().
+     */
+    std::vector<sp_RegisteredPlan> takePreparedRegistrations();
+
+    inline bool hasEvictedPlans() const {
+        return !evictedStatements_.empty();
+    }
+
+    /*
+     * Returns a command that deallocates the prepared statements of evicted plans
+     * and removes them from the list of statements waiting for deallocation.
+     */
+    std::string takeDeallocationCommand();
+
+    /*
+     * Processes the results of the command returned by takeDeallocationCommand().
+     * The first deallocatedCount statements were deallocated, the next one failed (and is dropped)
+     * and the remaining ones were skipped, so they're deallocated by the next command.
+     */
+    void statementsDeallocated(unsigned deallocatedCount);
+
+    /*
+     * Number of plans evicted from the cache; may be read from other threads.
+     */
+    inline uint64_t evictions() const {
+        return evictions_.load(std::memory_order_relaxed);
+    }
+
 private:
     static constexpr char const * PlanNamePrefix = "EnigmaPlan_";
 
     unsigned nextPlanId_{0};
+    // Approximate amount of server memory used by prepared statements (0 = unlimited)
+    size_t maxMemory_;
+    size_t memoryUsage_{0};
+    // Statements that were evicted from the cache but are still allocated on the server
+    std::vector<std::string> evictedStatements_;
+    // Statements being deallocated by the last command returned from takeDeallocationCommand()
+    std::vector<std::string> deallocatingStatements_;
+    // Plans kept after a connection reset that need to be prepared on the new connection
+    std::vector<std::string> unpreparedPlans_;
+    // Plans being prepared by the last command returned from takePrepareCommand()
+    std::vector<std::string> preparingPlans_;
+    // Plans that need to be described before the next query
+    std::vector<std::string> undescribedPlans_;
+    // Plan being described by the statement returned from takeUndescribedStatement()
+    std::string describingPlan_;
+    // Registry generation the cache was last warmed from
+    unsigned warmedGeneration_{ ~0u };
+    // Registered plans that couldn't be prepared on this connection
+    std::vector<sp_RegisteredPlan> failedRegistrations_;
+    // Registered plans prepared by this connection that weren't reported to the registry yet
+    std::vector<sp_RegisteredPlan> preparedRegistrations_;
+    std::atomic<uint64_t> evictions_{ 0 };
     folly::EvictingCacheMap<std::string, p_CachedPlan> plans_;
 
-    CachedPlan const * storePlan(std::string const & query, std::string const & statementName);
+    CachedPlan * storePlan(std::string const & query, std::string const & statementName);
+    void planEvicted(CachedPlan const & plan);
     std::string generatePlanName();
+    static size_t estimateMemoryUsage(std::string const & command);
+    static bool isRestorable(CachedPlan const & plan);
 };
 
 typedef std::unique_ptr<PlanCache> p_PlanCache;
 
+/*
+ * Counts the executions of plan cached commands across all connections of a pool,
+ * so that prepared statements are only created for commands that were executed
+ * at least [threshold] times. Other commands are executed as unnamed statements.
+ */
+class PlanExecutionCounter {
+public:
+    static const unsigned DefaultPrepareThreshold = 1;
+    static const unsigned MaxPrepareThreshold = 10000;
+    // Number of distinct commands to keep execution counts for
+    static const unsigned MaxTrackedCommands = 1000;
+
+    PlanExecutionCounter(unsigned threshold = DefaultPrepareThreshold);
+
+    PlanExecutionCounter(PlanExecutionCounter const &) = delete;
+    PlanExecutionCounter & operator = (PlanExecutionCounter const &) = delete;
+
+    void setThreshold(unsigned threshold);
+
+    /*
+     * Records an execution of the command and returns whether it
+     * reached the threshold for preparing a statement.
+     */
+    bool recordExecution(std::string const & command);
+
+private:
+    unsigned threshold_;
+    Mutex lock_;
+    folly::EvictingCacheMap<std::string, unsigned> executions_;
+};
+
+/*
+ * Pool-wide list of recently prepared statements, used for preparing them
+ * on the other connections of the pool before they're needed.
+ */
+class PlanRegistry {
+public:
+    PlanRegistry(unsigned size = PlanCache::DefaultPlanCacheSize);
+
+    PlanRegistry(PlanRegistry const &) = delete;
+    PlanRegistry & operator = (PlanRegistry const &) = delete;
+
+    void setSize(unsigned size);
+    sp_RegisteredPlan registerPlan(std::string const & command, std::vector<Oid> const & parameterTypes);
+    std::vector<sp_RegisteredPlan> plans() const;
+
+    /*
+     * Marks a plan as prepared successfully; other connections only prepare plans
+     * of the registry once they were prepared somewhere.
+     */
+    void planPrepared(RegisteredPlan & plan);
+
+    /*
+     * Writes the most frequently used plans to a file.
+     * Returns false if the file couldn't be written.
+     */
+    bool save(std::string const & path, unsigned count) const;
+
+    /*
+     * Registers the plans stored by save().
+     * Returns false if the file doesn't exist or is invalid.
+     */
+    bool load(std::string const & path);
+
+    /*
+     * Incremented each time a registered plan is prepared for the first time
+     */
+    inline unsigned generation() const {
+        return generation_.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr char const * FileHeader = "enigma-plans 1";
+
+    mutable Mutex lock_;
+    folly::EvictingCacheMap<std::string, sp_RegisteredPlan> plans_;
+    std::atomic<unsigned> generation_{0};
+};
+
 }
 }
 
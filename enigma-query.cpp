@@ -10,6 +10,11 @@ void throwEnigmaException(std::string const & message) {
     throw error;
 }
 
+void throwEnigmaException(std::string const & message, QueryTimings const & timings) {
+    auto error = ErrorResult::newInstance(message, timings);
+    throw error;
+}
+
 
 Query::Query(RawInit, String const & command)
         : type_(Type::Raw), command_(command)
@@ -23,10 +28,21 @@ Query::Query(ParameterizedInit, String const & command, Pgsql::PreparedParameter
         : type_(Type::Parameterized), command_(command), params_(params)
 {}
 
+Query::Query(ParameterizedInit, String const & command, Pgsql::PreparedParameters const & params,
+             Pgsql::PreparedParameters::BorrowInit)
+        : type_(Type::Parameterized), command_(command),
+          params_(Pgsql::PreparedParameters::BorrowInit{}, params)
+{}
+
 Query::Query(PrepareInit, String const & stmtName, String const & command, unsigned numParams)
         : type_(Type::Prepare), command_(command), statement_(stmtName), numParams_(numParams)
 {}
 
+Query::Query(PrepareInit, String const & stmtName, String const & command, std::vector<Oid> const & paramTypes)
+        : type_(Type::Prepare), command_(command), statement_(stmtName), numParams_(paramTypes.size()),
+          paramTypes_(paramTypes)
+{}
+
 Query::Query(PreparedInit, String const & stmtName, Array const & params)
         : type_(Type::Prepared), statement_(stmtName), params_(params)
 {}
@@ -35,6 +51,11 @@ Query::Query(PreparedInit, String const & stmtName, Pgsql::PreparedParameters co
         : type_(Type::Prepared), statement_(stmtName), params_(params)
 {}
 
+Query::Query(PreparedInit, String const & stmtName, Pgsql::PreparedParameters const & params,
+             Pgsql::PreparedParameters::BorrowInit)
+        : type_(Type::Prepared), statement_(stmtName), params_(Pgsql::PreparedParameters::BorrowInit{}, params)
+{}
+
 void Query::send(Pgsql::ConnectionResource & connection) {
     bool binary = (flags() & kBinary) == kBinary;
     switch (type()) {
@@ -52,7 +73,8 @@ void Query::send(Pgsql::ConnectionResource & connection) {
             break;
 
         case Query::Type::Prepare:
-            connection.sendPrepare(statement(), command(), numParams());
+            connection.sendPrepare(statement(), command(), numParams(),
+                                   paramTypes_.empty() ? nullptr : paramTypes_.data());
             break;
 
         case Query::Type::Prepared:
@@ -75,7 +97,8 @@ Pgsql::p_ResultResource Query::exec(Pgsql::ConnectionResource & connection) {
             }
 
         case Query::Type::Prepare:
-            return connection.prepare(statement(), command(), numParams());
+            return connection.prepare(statement(), command(), numParams(),
+                                      paramTypes_.empty() ? nullptr : paramTypes_.data());
 
         case Query::Type::Prepared:
             return connection.queryPrepared(statement(), params(), binary);
@@ -89,15 +112,22 @@ Pgsql::p_ResultResource Query::exec(Pgsql::ConnectionResource & connection) {
 const StaticString s_ErrorResult("ErrorResult"),
         s_ErrorResultNS("Enigma\\ErrorResult");
 
-Object ErrorResult::newInstance(std::string const & message) {
+Object ErrorResult::newInstance(std::string const & message, QueryTimings const & timings) {
     Object instance{Unit::lookupClass(s_ErrorResultNS.get())};
     Native::data<ErrorResult>(instance)
-            ->postConstruct(message);
+            ->postConstruct(message, timings);
     return instance;
 }
 
-void ErrorResult::postConstruct(std::string const & message) {
+void ErrorResult::attachTimings(Object const & error, QueryTimings const & timings) {
+    if (error.instanceof(Unit::lookupClass(s_ErrorResultNS.get()))) {
+        Native::data<ErrorResult>(error)->timings_ = timings;
+    }
+}
+
+void ErrorResult::postConstruct(std::string const & message, QueryTimings const & timings) {
     message_ = message;
+    timings_ = timings;
 }
 
 String HHVM_METHOD(ErrorResult, getMessage) {
@@ -105,14 +135,43 @@ String HHVM_METHOD(ErrorResult, getMessage) {
     return data->getMessage();
 }
 
+Array HHVM_METHOD(ErrorResult, getTimings) {
+    auto data = Native::data<ErrorResult>(this_);
+    return data->timings().toArray();
+}
+
 const StaticString
     s_QueryResult("QueryResult"),
-    s_QueryResultNS("Enigma\\QueryResult");
+    s_QueryResultNS("Enigma\\QueryResult"),
+    s_enqueued("enqueued"),
+    s_assigned("assigned"),
+    s_sent("sent"),
+    s_first_byte("first_byte"),
+    s_completed("completed"),
+    s_unserialized("unserialized");
+
+Array QueryTimings::toArray() const {
+    Array timings{Array::Create()};
+    auto add = [&timings] (StaticString const & name, Clock::time_point time) {
+        if (time != Clock::time_point()) {
+            timings.set(name, (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                    time.time_since_epoch()).count());
+        }
+    };
+
+    add(s_enqueued, enqueued);
+    add(s_assigned, assigned);
+    add(s_sent, sent);
+    add(s_first_byte, firstByte);
+    add(s_completed, completed);
+    add(s_unserialized, unserialized);
+    return timings;
+}
 
-Object QueryResult::newInstance(std::unique_ptr<Pgsql::ResultResource> results) {
+Object QueryResult::newInstance(std::unique_ptr<Pgsql::ResultResource> results, QueryTimings const & timings) {
     Object instance{Unit::lookupClass(s_QueryResultNS.get())};
     Native::data<QueryResult>(instance)
-            ->postConstruct(std::move(results));
+            ->postConstruct(std::move(results), timings);
     return instance;
 }
 
@@ -125,9 +184,16 @@ QueryResult & QueryResult::operator = (QueryResult const & src) {
     ));
 }
 
-void QueryResult::postConstruct(std::unique_ptr<Pgsql::ResultResource> results) {
+void QueryResult::postConstruct(std::unique_ptr<Pgsql::ResultResource> results, QueryTimings const & timings) {
     // TODO Result::create();
     results_ = std::move(results);
+    timings_ = timings;
+}
+
+
+Array HHVM_METHOD(QueryResult, getTimings) {
+    auto data = Native::data<QueryResult>(this_);
+    return data->timings().toArray();
 }
 
 
@@ -147,19 +213,20 @@ Array HHVM_METHOD(QueryResult, fetchArrays, int64_t flags) {
             colTypes[col] = resource.columnType(col);
         }
 
-        uint32_t valueFlags = (uint32_t)(flags & QueryResult::kResultResourceMask);
+        Pgsql::ParseContext valueContext((uint32_t)(flags & QueryResult::kResultResourceMask),
+                                         resource.serverTimezone());
         bool numbered = (bool)(flags & QueryResult::kNumbered);
         for (auto row = 0; row < rows; row++) {
             Array rowArr{Array::Create()};
             if (numbered) {
                 // Fetch arrays with 0, 1, ..., n as keys
                 for (auto col = 0; col < cols; col++) {
-                    rowArr.set(col, resource.typedValue(row, col, colTypes[col], valueFlags));
+                    rowArr.set(col, resource.typedValue(row, col, colTypes[col], valueContext));
                 }
             } else {
                 // Fetch arrays with column names as keys
                 for (auto col = 0; col < cols; col++) {
-                    rowArr.set(colNames[col], resource.typedValue(row, col, colTypes[col], valueFlags));
+                    rowArr.set(colNames[col], resource.typedValue(row, col, colTypes[col], valueContext));
                 }
             }
 
@@ -192,7 +259,8 @@ Array HHVM_METHOD(QueryResult, fetchObjects, String const & cls, int64_t flags,
             colTypes[col] = resource.columnType(col);
         }
 
-        uint32_t valueFlags = (uint32_t)(flags & QueryResult::kResultResourceMask);
+        Pgsql::ParseContext valueContext((uint32_t)(flags & QueryResult::kResultResourceMask),
+                                         resource.serverTimezone());
         bool callCtor = !(flags & QueryResult::kDontCallCtor);
         bool constructBeforeBind = (bool)(flags & QueryResult::kConstructBeforeBinding);
         /*
@@ -235,7 +303,7 @@ Array HHVM_METHOD(QueryResult, fetchObjects, String const & cls, int64_t flags,
                 auto props = rowObj->propVec();
                 for (auto col = 0; col < cols; col++) {
                     auto slot = propSlots[col];
-                    auto value = resource.typedValue(row, col, colTypes[col], valueFlags);
+                    auto value = resource.typedValue(row, col, colTypes[col], valueContext);
                     if (UNLIKELY(slot == kInvalidSlot)) {
                         if (useSetter) {
                             rowObj->o_set(propNames[col], value);
@@ -266,7 +334,7 @@ Array HHVM_METHOD(QueryResult, fetchObjects, String const & cls, int64_t flags,
                 }
 
                 for (auto col = 0; col < cols; col++) {
-                    rowObj->o_set(colNames[col], resource.typedValue(row, col, colTypes[col], valueFlags));
+                    rowObj->o_set(colNames[col], resource.typedValue(row, col, colTypes[col], valueContext));
                 }
 
                 if (!constructBeforeBind && callCtor) {
@@ -286,10 +354,12 @@ Array HHVM_METHOD(QueryResult, fetchObjects, String const & cls, int64_t flags,
 
 void registerClasses() {
     ENIGMA_ME(ErrorResult, getMessage);
+    ENIGMA_ME(ErrorResult, getTimings);
     Native::registerNativeDataInfo<ErrorResult>(s_ErrorResult.get());
 
     ENIGMA_ME(QueryResult, fetchArrays);
     ENIGMA_ME(QueryResult, fetchObjects);
+    ENIGMA_ME(QueryResult, getTimings);
     Native::registerNativeDataInfo<QueryResult>(s_QueryResult.get());
     HHVM_RCC_INT(QueryResultNS, NATIVE_JSON, Pgsql::ResultResource::kNativeJson);
     HHVM_RCC_INT(QueryResultNS, NATIVE_ARRAYS, Pgsql::ResultResource::kNativeArrays);
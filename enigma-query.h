@@ -4,6 +4,7 @@
 #include "hphp/runtime/ext/extension.h"
 #include "hphp/runtime/ext/asio/socket-event.h"
 #include "hphp/runtime/ext/asio/asio-external-thread-event.h"
+#include <chrono>
 #include "enigma-common.h"
 #include "enigma-plan.h"
 #include "pgsql-connection.h"
@@ -12,7 +13,10 @@
 namespace HPHP {
 namespace Enigma {
 
+struct QueryTimings;
+
 [[ noreturn ]] void throwEnigmaException(std::string const & message);
+[[ noreturn ]] void throwEnigmaException(std::string const & message, QueryTimings const & timings);
 
 class Query {
 public:
@@ -34,15 +38,24 @@ public:
 
     enum Flags {
         kCachePlan = 0x01,
-        kBinary = 0x02
+        kBinary = 0x02,
+        kBinaryParams = 0x04,
+        // Share the result of identical read queries running at the same time
+        kCoalesce = 0x08
     };
 
     Query(RawInit, String const & command);
     Query(ParameterizedInit, String const & command, Array const & params);
     Query(ParameterizedInit, String const & command, Pgsql::PreparedParameters const & params);
     Query(PrepareInit, String const & stmtName, String const & command, unsigned numParams);
+    Query(PrepareInit, String const & stmtName, String const & command, std::vector<Oid> const & paramTypes);
     Query(PreparedInit, String const & stmtName, Array const & params);
     Query(PreparedInit, String const & stmtName, Pgsql::PreparedParameters const & params);
+    // Queries that reference the string parameters of params; only for synchronous execution
+    Query(ParameterizedInit, String const & command, Pgsql::PreparedParameters const & params,
+          Pgsql::PreparedParameters::BorrowInit);
+    Query(PreparedInit, String const & stmtName, Pgsql::PreparedParameters const & params,
+          Pgsql::PreparedParameters::BorrowInit);
 
     Query(const Query &) = delete;
     Query & operator = (const Query &) = delete;
@@ -63,6 +76,10 @@ public:
         return numParams_;
     }
 
+    inline std::vector<Oid> const & paramTypes() const {
+        return paramTypes_;
+    }
+
     inline Pgsql::PreparedParameters const & params() const {
         return params_;
     }
@@ -83,6 +100,7 @@ private:
     String command_;
     String statement_;
     unsigned numParams_;
+    std::vector<Oid> paramTypes_;
     Pgsql::PreparedParameters params_;
     unsigned flags_{0};
 };
@@ -90,6 +108,33 @@ private:
 typedef std::unique_ptr<Query> p_Query;
 
 
+/*
+ * Monotonic timestamps of the lifecycle events of a query.
+ * Events that didn't happen (eg. cache hits are never sent to the server) are left unset.
+ */
+struct QueryTimings {
+    typedef std::chrono::steady_clock Clock;
+
+    // Query was added to the pool queue
+    Clock::time_point enqueued;
+    // Query was assigned to a connection
+    Clock::time_point assigned;
+    // Query was passed to libpq for sending
+    Clock::time_point sent;
+    // First response data was received from the server
+    Clock::time_point firstByte;
+    // Result was received
+    Clock::time_point completed;
+    // Result was passed to the client
+    Clock::time_point unserialized;
+
+    /*
+     * Returns the timestamps of the events that happened, in microseconds
+     */
+    Array toArray() const;
+};
+
+
 class Result {
     // TODO
 };
@@ -98,21 +143,32 @@ class Result {
 
 class ErrorResult : public Result {
 public:
-    static Object newInstance(std::string const & message);
+    static Object newInstance(std::string const & message, QueryTimings const & timings = QueryTimings());
+
+    /*
+     * Records the timings of the failed query on the error, if error is an ErrorResult.
+     */
+    static void attachTimings(Object const & error, QueryTimings const & timings);
 
     inline std::string const & getMessage() {
         return message_;
     }
 
+    inline QueryTimings const & timings() const {
+        return timings_;
+    }
+
 private:
     std::string message_;
+    QueryTimings timings_;
 
-    void postConstruct(std::string const & message);
+    void postConstruct(std::string const & message, QueryTimings const & timings);
 };
 
 class QueryResult : public Result {
 public:
-    static Object newInstance(std::unique_ptr<Pgsql::ResultResource> results);
+    static Object newInstance(std::unique_ptr<Pgsql::ResultResource> results,
+                              QueryTimings const & timings = QueryTimings());
 
     enum FetchOptions {
         // Lower 8 bits reserved for ResultResource flags
@@ -133,10 +189,15 @@ public:
         return *results_.get();
     }
 
+    inline QueryTimings const & timings() const {
+        return timings_;
+    }
+
 private:
     std::unique_ptr<Pgsql::ResultResource> results_;
+    QueryTimings timings_;
 
-    void postConstruct(std::unique_ptr<Pgsql::ResultResource> results);
+    void postConstruct(std::unique_ptr<Pgsql::ResultResource> results, QueryTimings const & timings);
 };
 
 void registerClasses();
@@ -1,6 +1,8 @@
 #include <hphp/util/conv-10.h>
+#include <algorithm>
 #include "enigma-queue.h"
 #include "enigma-transaction.h"
+#include "hphp/runtime/ext/asio/ext_static-wait-handle.h"
 #include "hphp/runtime/vm/native-data.h"
 
 namespace HPHP {
@@ -12,11 +14,119 @@ AssignmentManager::~AssignmentManager() {}
 const StaticString
     s_PoolSize("pool_size"),
     s_QueueSize("queue_size"),
-    s_PlanCacheSize("plan_cache_size");
+    s_PlanCacheSize("plan_cache_size"),
+    s_PlanCacheMemory("plan_cache_memory"),
+    s_PrepareThreshold("prepare_threshold"),
+    s_PlanCacheFile("plan_cache_file"),
+    s_ResultCacheMemory("result_cache_memory"),
+    s_QueueDepth("queue_depth"),
+    s_Connections("connections"),
+    s_IdleConnections("idle_connections"),
+    s_BusyConnections("busy_connections"),
+    s_ConnectingConnections("connecting_connections"),
+    s_Enqueued("enqueued"),
+    s_Completed("completed"),
+    s_Failed("failed"),
+    s_PlanCacheHits("plan_cache_hits"),
+    s_PlanCacheMisses("plan_cache_misses"),
+    s_PlanCacheEvictions("plan_cache_evictions"),
+    s_Reconnects("reconnects"),
+    s_QueueWaitTime("queue_wait_time"),
+    s_ExecutionTime("execution_time"),
+    s_Count("count"),
+    s_TotalMicros("total_us"),
+    s_Buckets("buckets"),
+    s_Inf("inf"),
+    s_Persistent("persistent");
+
+namespace {
+
+/*
+ * Fetch the results of cached plans using the binary protocol if it doesn't affect
+ * the decoded values of any result column.
+ */
+unsigned preparedQueryFlags(PlanCache::CachedPlan const & plan, unsigned flags) {
+    if (plan.description && plan.description->binaryResults) {
+        return flags | Query::kBinary;
+    } else {
+        return flags;
+    }
+}
+
+/*
+ * Completes the timings of a synchronous query that failed.
+ */
+QueryTimings const & failedQueryTimings(QueryTimings & timings) {
+    auto now = QueryTimings::Clock::now();
+    if (timings.sent != QueryTimings::Clock::time_point() && timings.completed == QueryTimings::Clock::time_point()) {
+        timings.completed = now;
+    }
+
+    timings.unserialized = now;
+    return timings;
+}
+
+/*
+ * Returns an already finished wait handle for results that didn't need a round trip to the server.
+ */
+Object finishedQuery(Pgsql::p_ResultResource result) {
+    QueryTimings timings;
+    timings.completed = timings.unserialized = QueryTimings::Clock::now();
+    auto queryResult = QueryResult::newInstance(std::move(result), timings);
+    return Object::attach(c_StaticWaitHandle::CreateSucceeded(
+            make_tv<KindOfObject>(queryResult.detach())));
+}
+
+}
+
+const uint64_t PoolStats::Histogram::BucketBounds[PoolStats::Histogram::BucketCount - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+PoolStats::Histogram::Histogram() {
+    for (auto & bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void PoolStats::Histogram::record(std::chrono::steady_clock::duration duration) {
+    auto micros = (uint64_t)std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    unsigned bucket = 0;
+    while (bucket < BucketCount - 1 && micros > BucketBounds[bucket]) {
+        bucket++;
+    }
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+/*
+ * Buckets are keyed by their upper bound in microseconds ("inf" for the last bucket).
+ */
+Array PoolStats::Histogram::toArray() const {
+    Array bucketCounts = Array::Create();
+    for (unsigned i = 0; i < BucketCount; i++) {
+        auto value = (int64_t)buckets[i].load(std::memory_order_relaxed);
+        if (i < BucketCount - 1) {
+            bucketCounts.set((int64_t)BucketBounds[i], value);
+        } else {
+            bucketCounts.set(s_Inf, value);
+        }
+    }
+
+    Array histogram = Array::Create();
+    histogram.set(s_Count, (int64_t)count.load(std::memory_order_relaxed));
+    histogram.set(s_TotalMicros, (int64_t)totalMicros.load(std::memory_order_relaxed));
+    histogram.set(s_Buckets, bucketCounts);
+    return histogram;
+}
 
 Pool::Pool(Array const & connectionOpts, Array const & poolOpts)
     : queue_(MaxQueueSize),
       idleConnections_(MaxPoolSize),
+      resultCache_(std::make_shared<ResultCache>()),
       transactionLifetimeManager_(new TransactionLifetimeManager()) {
     if (poolOpts.exists(s_PoolSize)) {
         auto size = (unsigned)poolOpts[s_PoolSize].toInt32();
@@ -43,6 +153,45 @@ Pool::Pool(Array const & connectionOpts, Array const & poolOpts)
         }
 
         planCacheSize_ = size;
+        planRegistry_.setSize(size);
+    }
+
+    if (poolOpts.exists(s_PlanCacheMemory)) {
+        auto memory = poolOpts[s_PlanCacheMemory].toInt64();
+        if (memory < 0 || memory > (int64_t)PlanCache::MaxPlanCacheMemory) {
+            throwEnigmaException("Invalid plan cache memory limit specified");
+        }
+
+        planCacheMemory_ = (size_t)memory;
+    }
+
+    if (poolOpts.exists(s_PrepareThreshold)) {
+        auto threshold = (unsigned)poolOpts[s_PrepareThreshold].toInt32();
+        if (threshold > PlanExecutionCounter::MaxPrepareThreshold) {
+            throwEnigmaException("Invalid prepare threshold specified");
+        }
+
+        planExecutions_.setThreshold(threshold);
+    }
+
+    if (poolOpts.exists(s_ResultCacheMemory)) {
+        auto memory = poolOpts[s_ResultCacheMemory].toInt64();
+        if (memory < 0 || memory > (int64_t)ResultCache::MaxMemory) {
+            throwEnigmaException("Invalid result cache memory limit specified");
+        }
+
+        resultCache_->setMaxMemory((size_t)memory);
+    }
+
+    /*
+     * Restore the most frequently used plans of the previous process; they are prepared
+     * on each connection when it's first opened.
+     */
+    if (poolOpts.exists(s_PlanCacheFile) && poolOpts.exists(s_Persistent) && poolOpts[s_Persistent].toBoolean()) {
+        planCacheFile_ = poolOpts[s_PlanCacheFile].toString().toCppString();
+        planRegistry_.load(planCacheFile_);
+        nextPlanCacheSave_ = std::chrono::steady_clock::now()
+                + std::chrono::seconds(static_cast<int64_t>(PlanCacheSaveInterval));
     }
 
     Pgsql::ConnectionOptions pgsqlOpts;
@@ -51,16 +200,22 @@ Pool::Pool(Array const & connectionOpts, Array const & poolOpts)
                 iter.first().toString().toCppString(), iter.second().toString().toCppString()));
     }
 
+    resultCacheListener_.reset(new ResultCacheListener(pgsqlOpts, resultCache_));
+
     for (unsigned i = 0; i < poolSize_; i++) {
         addConnection(pgsqlOpts);
     }
 }
 
 Pool::~Pool() {
+    if (!planCacheFile_.empty()) {
+        planRegistry_.save(planCacheFile_, PlanCache::MaxRestoredPlans);
+    }
 }
 
 void Pool::addConnection(Pgsql::ConnectionOptions const & options) {
-    auto connection = std::make_shared<Connection>(options, planCacheSize_);
+    auto connection = std::make_shared<Connection>(options, planCacheSize_, planCacheMemory_);
+    connection->planCache().warm(planRegistry_);
     auto connectionId = nextConnectionIndex_++;
     connectionMap_.insert(std::make_pair(connectionId, connection));
     idleConnections_.blockingWrite(connectionId);
@@ -69,20 +224,11 @@ void Pool::addConnection(Pgsql::ConnectionOptions const & options) {
 
 void Pool::removeConnection(ConnectionId connectionId) {
     transactionLifetimeManager_->notifyConnectionRemoved(connectionId);
-    auto prepareIt = preparing_.find(connectionId);
-    if (prepareIt != preparing_.end()) {
-        preparing_.erase(prepareIt);
-    }
-
-    auto pendingPrepareIt = pendingPrepare_.find(connectionId);
-    if (pendingPrepareIt != pendingPrepare_.end()) {
-        pendingPrepare_.erase(pendingPrepareIt);
-    }
-
     connectionMap_.erase(connectionId);
 }
 
-QueryAwait * Pool::enqueue(p_Query query, PoolHandle * handle) {
+QueryAwait * Pool::enqueue(p_Query query, PoolHandle * handle, ResultCacheRequest cacheRequest,
+                           std::string coalesceKey) {
     if (queue_.size() >= maxQueueSize_) {
         // TODO improve error reporting
         throw Exception("Enigma queue size exceeded");
@@ -90,17 +236,28 @@ QueryAwait * Pool::enqueue(p_Query query, PoolHandle * handle) {
 
     ENIG_DEBUG("Pool::enqueue(): create QueryAwait");
     auto event = new QueryAwait(std::move(query));
+    if (cacheRequest.enabled()) {
+        event->cacheResult(resultCache_, std::move(cacheRequest));
+    }
+
+    if (!coalesceKey.empty()) {
+        event->coalesce(&inflightQueries_, std::move(coalesceKey));
+    }
+
     enqueue(event, handle);
     return event;
 }
 
 void Pool::enqueue(QueryAwait * event, PoolHandle * handle) {
+    event->timings().enqueued = QueryTimings::Clock::now();
     if (!transactionLifetimeManager_->enqueue(event, handle)) {
         if (!queue_.writeIfNotFull(QueueItem{event, handle})) {
             throw Exception("Enigma queue size exceeded");
         }
     }
 
+    // Rejected queries are not counted, as they never complete or fail
+    stats_.enqueued.fetch_add(1, std::memory_order_relaxed);
     tryExecuteNext();
 }
 
@@ -120,6 +277,36 @@ void Pool::createHandle(PoolHandle * handle) {
 
 void Pool::releaseHandle(PoolHandle * handle) {
     transactionLifetimeManager_->notifyHandleReleased(handle);
+    savePlanCache();
+}
+
+void Pool::publishPreparedPlans(Connection & connection) {
+    for (auto const & registration : connection.planCache().takePreparedRegistrations()) {
+        planRegistry_.planPrepared(*registration);
+    }
+}
+
+/*
+ * Periodically writes the most frequently used plans to the plan cache file.
+ */
+void Pool::savePlanCache() {
+    if (planCacheFile_.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    {
+        Lock l(planCacheSaveLock_);
+        if (now < nextPlanCacheSave_) {
+            return;
+        }
+
+        nextPlanCacheSave_ = now + std::chrono::seconds(static_cast<int64_t>(PlanCacheSaveInterval));
+    }
+
+    if (!planRegistry_.save(planCacheFile_, PlanCache::MaxRestoredPlans)) {
+        LOG(ERROR) << "Failed to write plan cache file " << planCacheFile_;
+    }
 }
 
 ConnectionId Pool::assignConnectionId(PoolHandle * handle) {
@@ -162,9 +349,24 @@ void Pool::tryExecuteNext() {
 void Pool::execute(ConnectionId connectionId, QueryAwait * query, PoolHandle * handle) {
     ENIG_DEBUG("Pool::execute");
 
+    auto & timings = query->timings();
+    timings.assigned = QueryTimings::Clock::now();
+    if (timings.enqueued != QueryTimings::Clock::time_point()) {
+        stats_.queueWaitTime.record(timings.assigned - timings.enqueued);
+    }
+
     auto connection = connectionMap_[connectionId];
     auto const & q = query->query();
 
+    /*
+     * Prepare statements that were prepared on other connections if no other queries are waiting;
+     * they're sent to the server in a single command before the query.
+     * (A failing PREPARE would abort the transaction, so this is only done outside of transactions)
+     */
+    if (queue_.isEmpty() && connection->isIdle()) {
+        connection->planCache().warm(planRegistry_);
+    }
+
     /*
      * Check if the query is a candidate for automatic prepared statement generation
      * and if planning has already taken place for this query.
@@ -172,40 +374,68 @@ void Pool::execute(ConnectionId connectionId, QueryAwait * query, PoolHandle * h
     if (q.flags() & Query::kCachePlan && q.type() == Query::Type::Parameterized) {
         auto plan = connection->planCache().lookupPlan(q.command().c_str());
         if (plan) {
+            stats_.planCacheHits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            stats_.planCacheMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (!plan && !planExecutions_.recordExecution(q.command().toCppString())) {
             /*
-             * Query was already prepared on this connection, use the
-             * auto assigned statement handle.
+             * The query wasn't executed frequently enough to be worth preparing;
+             * execute it as an unnamed statement.
              */
-            ENIG_DEBUG("Begin executing cached prepared stmt");
-            p_Query execQuery(new Query(
-                    Query::PreparedInit{}, plan->statementName, q.params()));
-            query->swapQuery(std::move(execQuery));
+            ENIG_DEBUG("Begin executing query below prepare threshold");
         } else {
+            if (!plan) {
+                /*
+                 * Schedule preparing the statement on this connection; the statement is
+                 * prepared right before the query is sent.
+                 */
+                ENIG_DEBUG("Begin preparing");
+                std::vector<Oid> types;
+                if (q.params().typeBuffer() != nullptr) {
+                    types.assign(q.params().types().begin(), q.params().types().end());
+                }
+
+                auto registration = planRegistry_.registerPlan(q.command().toCppString(), types);
+                plan = connection->planCache().schedulePlan(registration);
+            }
+
             /*
-             * Begin preparing the query and store the original query params
-             * for later execution.
+             * Execute the query using the auto assigned statement handle.
+             * Statements that can't be prepared in advance are executed as unnamed statements.
              */
-            ENIG_DEBUG("Begin preparing");
-            plan = connection->planCache().assignPlan(q.command().c_str());
-            p_Query planQuery(new Query(
-                    Query::PrepareInit{}, plan->statementName, plan->planInfo.rewrittenCommand,
-                    plan->planInfo.parameterCount));
-            auto originalQuery = query->swapQuery(std::move(planQuery));
-            preparing_.insert(std::make_pair(connectionId, QueueItem{query, handle}));
-            pendingPrepare_.insert(std::make_pair(connectionId, std::move(originalQuery)));
+            if (plan) {
+                ENIG_DEBUG("Begin executing cached prepared stmt");
+                connection->planCache().requestDescription(plan->planInfo.command);
+                Pgsql::PreparedParameters params(q.params());
+                params.conformTo(plan->bindTypes());
+                p_Query execQuery(new Query(
+                        Query::PreparedInit{}, plan->statementName, params));
+                execQuery->setFlags(preparedQueryFlags(*plan, q.flags()));
+                query->swapQuery(std::move(execQuery));
+            }
         }
     } else {
         ENIG_DEBUG("Begin executing query");
     }
 
-    auto callback = [this, connectionId, handle] {
-        this->queryCompleted(connectionId, handle);
+    auto callback = [this, connectionId, handle, query] {
+        this->queryCompleted(connectionId, handle, query);
     };
     query->assign(connection);
     query->begin(callback);
 }
 
-void Pool::queryCompleted(ConnectionId connectionId, PoolHandle * handle) {
+void Pool::queryCompleted(ConnectionId connectionId, PoolHandle * handle, QueryAwait * query) {
+    publishPreparedPlans(*connectionMap_[connectionId]);
+    stats_.executionTime.record(QueryTimings::Clock::now() - query->timings().assigned);
+    if (query->succeeded()) {
+        stats_.completed.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        stats_.failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
     if (transactionLifetimeManager_->notifyFinishAssignment(handle, connectionId)) {
         releaseConnection(connectionId);
     } else {
@@ -218,6 +448,41 @@ void Pool::queryCompleted(ConnectionId connectionId, PoolHandle * handle) {
     tryExecuteNext();
 }
 
+Array Pool::getStats() {
+    int64_t connecting = 0;
+    uint64_t evictions = 0, reconnects = 0;
+    for (auto const & it : connectionMap_) {
+        auto state = it.second->state();
+        if (state == Connection::State::Connecting || state == Connection::State::Resetting) {
+            connecting++;
+        }
+
+        evictions += it.second->planCache().evictions();
+        reconnects += it.second->reconnects();
+    }
+
+    // Connections that are neither in the idle queue nor connecting are executing queries or hold a transaction
+    auto idle = std::max<int64_t>(0, idleConnections_.size());
+    auto total = (int64_t)connectionMap_.size();
+
+    Array stats = Array::Create();
+    stats.set(s_QueueDepth, std::max<int64_t>(0, queue_.size()));
+    stats.set(s_Connections, total);
+    stats.set(s_IdleConnections, idle);
+    stats.set(s_BusyConnections, std::max<int64_t>(0, total - idle - connecting));
+    stats.set(s_ConnectingConnections, connecting);
+    stats.set(s_Enqueued, (int64_t)stats_.enqueued.load(std::memory_order_relaxed));
+    stats.set(s_Completed, (int64_t)stats_.completed.load(std::memory_order_relaxed));
+    stats.set(s_Failed, (int64_t)stats_.failed.load(std::memory_order_relaxed));
+    stats.set(s_PlanCacheHits, (int64_t)stats_.planCacheHits.load(std::memory_order_relaxed));
+    stats.set(s_PlanCacheMisses, (int64_t)stats_.planCacheMisses.load(std::memory_order_relaxed));
+    stats.set(s_PlanCacheEvictions, (int64_t)evictions);
+    stats.set(s_Reconnects, (int64_t)reconnects);
+    stats.set(s_QueueWaitTime, stats_.queueWaitTime.toArray());
+    stats.set(s_ExecutionTime, stats_.executionTime.toArray());
+    return stats;
+}
+
 sp_Pool PersistentPoolStorage::make(Array const & connectionOpts, Array const & poolOpts) {
     {
         ReadLock l(lock_);
@@ -300,48 +565,171 @@ void PoolHandle::bindConnection() {
     }
 }
 
-Pgsql::p_ResultResource PoolHandle::query(String const & command, Array const & params, unsigned flags) {
+bool PoolHandle::inTransaction() const {
     if (connection_) {
-        return query(connection_->getConnection(), command, params, flags);
+        return connection_->getConnection()->inTransaction();
+    } else {
+        return transaction_.connectionId != Pool::InvalidConnectionId;
+    }
+}
+
+void PoolHandle::setMemoization(bool enabled) {
+    if (!enabled) {
+        memo_.reset();
+    } else if (!memo_) {
+        memo_ = std::make_shared<QueryMemo>();
+    }
+}
+
+std::string PoolHandle::memoKey(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                unsigned flags) {
+    if (!memo_) {
+        return std::string();
+    }
+
+    if (!planInfo.isSelect() || inTransaction()) {
+        memo_->invalidate();
+        return std::string();
+    }
+
+    return ResultCache::makeKey(planInfo, params, flags);
+}
+
+ResultCacheRequest PoolHandle::resultCacheRequest(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                                  unsigned flags, unsigned ttl,
+                                                  std::vector<std::string> const & tags) const {
+    ResultCacheRequest request;
+    if (ttl > 0 && planInfo.isSelect() && !inTransaction()) {
+        request.key = ResultCache::makeKey(planInfo, params, flags);
+        request.ttl = ttl;
+        if (!tags.empty()) {
+            pool_->resultCacheListener().listen(tags);
+            request.tags = tags;
+            pool_->resultCache()->snapshotTags(request);
+        }
+    }
+
+    return request;
+}
+
+Pgsql::p_ResultResource PoolHandle::cachedResult(ResultCacheRequest const & cacheRequest) const {
+    if (!cacheRequest.enabled()) {
+        return nullptr;
+    }
+
+    return pool_->resultCache()->lookup(cacheRequest.key);
+}
+
+Pgsql::p_ResultResource PoolHandle::query(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                          unsigned flags, ResultCacheRequest const & cacheRequest,
+                                          QueryTimings * timings) {
+    Pgsql::p_ResultResource result;
+    if (timings) {
+        timings->enqueued = QueryTimings::Clock::now();
+    }
+
+    if (connection_) {
+        auto connection = connection_->getConnection();
+        if (timings) {
+            timings->assigned = timings->sent = QueryTimings::Clock::now();
+        }
+
+        result = query(connection, planInfo, params, flags);
     } else {
         PoolConnectionHandle ch(pool_);
         auto connection = ch.getConnection();
+        if (timings) {
+            timings->assigned = QueryTimings::Clock::now();
+        }
+
         connection->ensureConnected();
-        return query(connection, command, params, flags);
+        if (timings) {
+            timings->sent = QueryTimings::Clock::now();
+        }
+
+        result = query(connection, planInfo, params, flags);
     }
+
+    if (timings) {
+        timings->completed = QueryTimings::Clock::now();
+    }
+
+    pool_->resultCache()->store(cacheRequest, *result);
+    return result;
 }
 
-Pgsql::p_ResultResource PoolHandle::query(sp_Connection connection, String const & command, Array const & params, unsigned flags) {
-    std::string sql = command.c_str();
+Pgsql::p_ResultResource PoolHandle::query(sp_Connection connection, PlanInfo const & planInfo,
+                                          Pgsql::PreparedParameters const & params, unsigned flags) {
     Pgsql::p_ResultResource result;
+    connection->flushPlanCache();
+    pool_->publishPreparedPlans(*connection);
     if (flags & Query::kCachePlan) {
-        auto plan = connection->planCache().lookupPlan(sql);
-        if (plan == nullptr) {
-            plan = connection->planCache().assignPlan(sql);
-            if (plan != nullptr) {
+        auto plan = connection->planCache().lookupPlan(planInfo.command);
+        if (plan) {
+            pool_->stats().planCacheHits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            pool_->stats().planCacheMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (plan == nullptr && pool_->planExecutions().recordExecution(planInfo.command)) {
+            auto newPlan = connection->planCache().assignPlan(planInfo.command);
+            if (newPlan != nullptr) {
                 try {
-                    Query query(Query::PrepareInit {}, plan->statementName, plan->planInfo.rewrittenCommand,
-                            plan->planInfo.parameterCount);
-                    query.exec(connection->connection());
+                    /*
+                     * Prepare the statement with the parameter types of the first execution,
+                     * so binary parameters can be passed to subsequent executions as-is.
+                     */
+                    Pgsql::p_ResultResource prepareResult;
+                    if (params.typeBuffer() != nullptr) {
+                        newPlan->parameterTypes.assign(params.types().begin(), params.types().end());
+                        Query query(Query::PrepareInit {}, newPlan->statementName, newPlan->planInfo.rewrittenCommand,
+                                newPlan->parameterTypes);
+                        prepareResult = query.exec(connection->connection());
+                    } else {
+                        Query query(Query::PrepareInit {}, newPlan->statementName, newPlan->planInfo.rewrittenCommand,
+                                newPlan->planInfo.parameterCount);
+                        prepareResult = query.exec(connection->connection());
+                    }
+
+                    std::string lastError;
+                    if (!connection->isQuerySuccessful(*prepareResult.get(), lastError)) {
+                        throwEnigmaException(lastError);
+                    }
                 } catch (...) {
-                    connection->planCache().forgetPlan(sql);
+                    connection->planCache().forgetPlan(planInfo.command);
                     throw;
                 }
+
+                newPlan->prepared = true;
+                newPlan->registration = pool_->planRegistry().registerPlan(planInfo.command, newPlan->parameterTypes);
+                pool_->planRegistry().planPrepared(*newPlan->registration);
+                plan = newPlan;
             }
         }
 
         if (plan != nullptr) {
-            auto bindableParams = plan->planInfo.mapParameters(params);
-            Query query(Query::PreparedInit{}, plan->statementName, bindableParams);
-            query.setFlags(flags);
+            if (connection->planCache().requestDescription(planInfo.command)) {
+                connection->describePlans();
+            }
+
+            if (plan->description && plan->description->parameterTypes.size() != (size_t)params.count()) {
+                throwEnigmaException(std::string("Parameter count mismatch; statement expects ")
+                        + std::to_string(plan->description->parameterTypes.size()) + " parameters, got "
+                        + std::to_string(params.count()));
+            }
+
+            Pgsql::PreparedParameters bindableParams(Pgsql::PreparedParameters::BorrowInit{}, params);
+            bindableParams.conformTo(plan->bindTypes());
+            Query query(Query::PreparedInit{}, plan->statementName, bindableParams,
+                        Pgsql::PreparedParameters::BorrowInit{});
+            query.setFlags(preparedQueryFlags(*plan, flags));
             result = query.exec(connection->connection());
         }
     }
 
     if (!result) {
-        PlanInfo planInfo(sql);
-        auto bindableParams = planInfo.mapParameters(params);
-        Query query(Query::ParameterizedInit{}, planInfo.rewrittenCommand, bindableParams);
+        Query query(Query::ParameterizedInit{}, planInfo.rewrittenCommand, params,
+                    Pgsql::PreparedParameters::BorrowInit{});
         query.setFlags(flags);
         result = query.exec(connection->connection());
     };
@@ -354,12 +742,33 @@ Pgsql::p_ResultResource PoolHandle::query(sp_Connection connection, String const
     return result;
 }
 
-QueryAwait * PoolHandle::asyncQuery(String const & command, Array const & params, unsigned flags) {
-    PlanInfo planInfo(command.c_str());
-    auto bindableParams = planInfo.mapParameters(params);
-    auto query = new Query(Query::ParameterizedInit{}, planInfo.rewrittenCommand, bindableParams);
+QueryAwait * PoolHandle::asyncQuery(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                    unsigned flags, ResultCacheRequest cacheRequest) {
+    /*
+     * Wait for the result of an identical running query instead of executing the query again.
+     * Only reads are coalesced; queries in transactions may see uncommitted changes,
+     * so they're never coalesced either.
+     */
+    std::string coalesceKey;
+    if ((flags & Query::kCoalesce) && planInfo.isSelect() && !inTransaction()) {
+        coalesceKey = ResultCache::makeKey(planInfo, params, flags);
+        auto event = pool_->inflightQueries().follow(coalesceKey);
+        if (event != nullptr) {
+            return event;
+        }
+    }
+
+    p_Query query(new Query(Query::ParameterizedInit{}, planInfo.rewrittenCommand, params));
     query->setFlags(flags);
-    return pool_->enqueue(p_Query(query), this);
+    try {
+        return pool_->enqueue(std::move(query), this, std::move(cacheRequest), coalesceKey);
+    } catch (std::exception & e) {
+        if (!coalesceKey.empty()) {
+            pool_->inflightQueries().complete(coalesceKey, false, nullptr, e.what());
+        }
+
+        throw;
+    }
 }
 
 
@@ -389,7 +798,7 @@ void HHPoolHandle::sweep() {
     handle.reset();
 }
 
-Object HHVM_METHOD(HHPoolHandle, syncQuery, Object const & queryObj) {
+Object HHVM_METHOD(HHPoolHandle, executeSyncQuery, Object const & queryObj) {
     auto poolHandle = Native::data<HHPoolHandle>(this_);
     if (!poolHandle->handle) {
         throwEnigmaException(
@@ -403,16 +812,47 @@ Object HHVM_METHOD(HHPoolHandle, syncQuery, Object const & queryObj) {
     }
 
     auto queryData = Native::data<QueryInterface>(queryObj);
+    QueryTimings timings;
 
     try {
-        auto result = poolHandle->handle->query(queryData->command(), queryData->params(), queryData->flags());
-        return Object{QueryResult::newInstance(std::move(result))};
+        auto const & memo = poolHandle->handle->memo();
+        auto memoKey = poolHandle->handle->memoKey(queryData->planInfo(), queryData->preparedParams(),
+                                                   queryData->flags());
+        if (!memoKey.empty()) {
+            auto memoized = memo->lookup(memoKey);
+            if (memoized) {
+                timings.completed = timings.unserialized = QueryTimings::Clock::now();
+                return Object{QueryResult::newInstance(std::move(memoized), timings)};
+            }
+        }
+
+        auto cacheRequest = poolHandle->handle->resultCacheRequest(queryData->planInfo(),
+                queryData->preparedParams(), queryData->flags(), queryData->resultCacheTtl(),
+                queryData->resultCacheTags());
+        auto result = poolHandle->handle->cachedResult(cacheRequest);
+        if (result) {
+            timings.completed = QueryTimings::Clock::now();
+        } else {
+            result = poolHandle->handle->query(queryData->planInfo(), queryData->preparedParams(),
+                                               queryData->flags(), cacheRequest, &timings);
+        }
+
+        if (!memoKey.empty()) {
+            memo->store(memoKey, memo->generation(), *result);
+        }
+
+        timings.unserialized = QueryTimings::Clock::now();
+        return Object{QueryResult::newInstance(std::move(result), timings)};
+    } catch (Object & error) {
+        // Query errors are raised as ErrorResult objects; pass the timings of the failed query with them
+        ErrorResult::attachTimings(error, failedQueryTimings(timings));
+        throw;
     } catch (std::exception & e) {
-        throwEnigmaException(e.what());
+        throwEnigmaException(e.what(), failedQueryTimings(timings));
     }
 }
 
-Object HHVM_METHOD(HHPoolHandle, asyncQuery, Object const & queryObj) {
+Object HHVM_METHOD(HHPoolHandle, executeAsyncQuery, Object const & queryObj) {
     auto poolHandle = Native::data<HHPoolHandle>(this_);
     if (!poolHandle->handle) {
         throwEnigmaException(
@@ -428,7 +868,35 @@ Object HHVM_METHOD(HHPoolHandle, asyncQuery, Object const & queryObj) {
     auto queryData = Native::data<QueryInterface>(queryObj);
 
     try {
-        auto waitEvent = poolHandle->handle->asyncQuery(queryData->command(), queryData->params(), queryData->flags());
+        auto const & memo = poolHandle->handle->memo();
+        auto memoKey = poolHandle->handle->memoKey(queryData->planInfo(), queryData->preparedParams(),
+                                                   queryData->flags());
+        if (!memoKey.empty()) {
+            auto memoized = memo->lookup(memoKey);
+            if (memoized) {
+                return finishedQuery(std::move(memoized));
+            }
+        }
+
+        auto cacheRequest = poolHandle->handle->resultCacheRequest(queryData->planInfo(),
+                queryData->preparedParams(), queryData->flags(), queryData->resultCacheTtl(),
+                queryData->resultCacheTags());
+        auto cached = poolHandle->handle->cachedResult(cacheRequest);
+        if (cached) {
+            // Cache hits are returned without going through the pool queue
+            if (!memoKey.empty()) {
+                memo->store(memoKey, memo->generation(), *cached);
+            }
+
+            return finishedQuery(std::move(cached));
+        }
+
+        auto waitEvent = poolHandle->handle->asyncQuery(queryData->planInfo(), queryData->preparedParams(),
+                                                        queryData->flags(), std::move(cacheRequest));
+        if (!memoKey.empty()) {
+            waitEvent->memoize(memo, memoKey, memo->generation());
+        }
+
         return Object{waitEvent->getWaitHandle()};
     } catch (std::exception & e) {
         throwEnigmaException(e.what());
@@ -447,6 +915,28 @@ void HHVM_METHOD(HHPoolHandle, bindConnection) {
 }
 
 
+void HHVM_METHOD(HHPoolHandle, enableMemoization, bool enabled) {
+    auto poolHandle = Native::data<HHPoolHandle>(this_);
+    if (!poolHandle->handle) {
+        throwEnigmaException(
+                "Pool::enableMemoization(): Pool handle already released");
+    }
+
+    poolHandle->handle->setMemoization(enabled);
+}
+
+
+Array HHVM_METHOD(HHPoolHandle, getStats) {
+    auto poolHandle = Native::data<HHPoolHandle>(this_);
+    if (!poolHandle->handle) {
+        throwEnigmaException(
+                "Pool::getStats(): Pool handle already released");
+    }
+
+    return poolHandle->handle->pool()->getStats();
+}
+
+
 void HHVM_METHOD(HHPoolHandle, release) {
     auto poolHandle = Native::data<HHPoolHandle>(this_);
     if (!poolHandle->handle) {
@@ -461,6 +951,31 @@ void HHVM_METHOD(HHPoolHandle, release) {
 void QueryInterface::init(String const & command, Array const & params) {
     command_ = command;
     params_ = params;
+    planInfo_.reset();
+    preparedParams_.reset();
+}
+
+void QueryInterface::bind(Array const & params) {
+    params_ = params;
+    preparedParams_.reset();
+}
+
+PlanInfo const & QueryInterface::planInfo() {
+    if (!planInfo_) {
+        planInfo_.reset(new PlanInfo(command_.toCppString()));
+        parameterKeys_ = planInfo_->parameterKeys();
+    }
+
+    return *planInfo_;
+}
+
+Pgsql::PreparedParameters const & QueryInterface::preparedParams() {
+    if (!preparedParams_) {
+        preparedParams_.reset(new Pgsql::PreparedParameters(planInfo().mapParameters(params_, parameterKeys_),
+                (flags_ & Query::kBinaryParams) == Query::kBinaryParams));
+    }
+
+    return *preparedParams_;
 }
 
 
@@ -470,6 +985,12 @@ void HHVM_METHOD(QueryInterface, __construct, String const & command, Array cons
 }
 
 
+void HHVM_METHOD(QueryInterface, bind, Array const & params) {
+    auto query = Native::data<QueryInterface>(this_);
+    query->bind(params);
+}
+
+
 void HHVM_METHOD(QueryInterface, enablePlanCache, bool enabled) {
     auto query = Native::data<QueryInterface>(this_);
     auto flags = query->flags();
@@ -481,6 +1002,39 @@ void HHVM_METHOD(QueryInterface, enablePlanCache, bool enabled) {
 }
 
 
+void HHVM_METHOD(QueryInterface, enableCoalescing, bool enabled) {
+    auto query = Native::data<QueryInterface>(this_);
+    auto flags = query->flags();
+    if (enabled) {
+        query->setFlags(flags | Query::kCoalesce);
+    } else {
+        query->setFlags(flags & ~Query::kCoalesce);
+    }
+}
+
+
+void HHVM_METHOD(QueryInterface, enableResultCache, int64_t ttl, Array const & tags) {
+    auto query = Native::data<QueryInterface>(this_);
+    if (ttl < 0 || ttl > ResultCache::MaxTtl) {
+        SystemLib::throwInvalidArgumentExceptionObject(
+                "Query::enableResultCache(): Invalid TTL specified");
+    }
+
+    std::vector<std::string> tagList;
+    for (ArrayIter iter(tags); iter; ++iter) {
+        if (!iter.second().isString() || iter.second().toString().empty()) {
+            SystemLib::throwInvalidArgumentExceptionObject(
+                    "Query::enableResultCache(): Tags must be non-empty strings");
+        }
+
+        tagList.push_back(iter.second().toString().toCppString());
+    }
+
+    query->setResultCacheTtl((unsigned)ttl);
+    query->setResultCacheTags(std::move(tagList));
+}
+
+
 void HHVM_METHOD(QueryInterface, setBinary, bool enabled) {
     auto query = Native::data<QueryInterface>(this_);
     auto flags = query->flags();
@@ -492,18 +1046,37 @@ void HHVM_METHOD(QueryInterface, setBinary, bool enabled) {
 }
 
 
+void HHVM_METHOD(QueryInterface, setBinaryParams, bool enabled) {
+    auto query = Native::data<QueryInterface>(this_);
+    auto flags = query->flags();
+    if (enabled) {
+        query->setFlags(flags | Query::kBinaryParams);
+    } else {
+        query->setFlags(flags & ~Query::kBinaryParams);
+    }
+}
+
+
 void registerQueueClasses() {
-    ENIGMA_NAMED_ME(HHPoolHandle, Pool, asyncQuery);
-    ENIGMA_NAMED_ME(HHPoolHandle, Pool, syncQuery);
+    ENIGMA_NAMED_ME(HHPoolHandle, Pool, executeAsyncQuery);
+    ENIGMA_NAMED_ME(HHPoolHandle, Pool, executeSyncQuery);
     ENIGMA_NAMED_ME(HHPoolHandle, Pool, bindConnection);
+    ENIGMA_NAMED_ME(HHPoolHandle, Pool, enableMemoization);
+    ENIGMA_NAMED_ME(HHPoolHandle, Pool, getStats);
     ENIGMA_NAMED_ME(HHPoolHandle, Pool, release);
     Native::registerNativeDataInfo<HHPoolHandle>(s_PoolHandle.get());
 
     ENIGMA_NAMED_ME(QueryInterface, Query, __construct);
+    ENIGMA_NAMED_ME(QueryInterface, Query, bind);
     ENIGMA_NAMED_ME(QueryInterface, Query, enablePlanCache);
+    ENIGMA_NAMED_ME(QueryInterface, Query, enableResultCache);
+    ENIGMA_NAMED_ME(QueryInterface, Query, enableCoalescing);
     ENIGMA_NAMED_ME(QueryInterface, Query, setBinary);
+    ENIGMA_NAMED_ME(QueryInterface, Query, setBinaryParams);
     HHVM_RCC_INT(QueryInterfaceNS, CACHE_PLAN, Query::kCachePlan);
     HHVM_RCC_INT(QueryInterfaceNS, BINARY, Query::kBinary);
+    HHVM_RCC_INT(QueryInterfaceNS, BINARY_PARAMS, Query::kBinaryParams);
+    HHVM_RCC_INT(QueryInterfaceNS, COALESCE, Query::kCoalesce);
     Native::registerNativeDataInfo<QueryInterface>(s_QueryInterface.get());
 }
 
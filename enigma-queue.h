@@ -2,12 +2,15 @@
 #define HPHP_ENIGMA_QUEUE_H
 
 #include "hphp/runtime/ext/extension.h"
+#include <atomic>
+#include <chrono>
 #include <folly/MPMCQueue.h>
 #include <folly/ProducerConsumerQueue.h>
 #include <folly/EvictingCacheMap.h>
 #include "enigma-common.h"
 #include "enigma-query.h"
 #include "enigma-async.h"
+#include "enigma-cache.h"
 #include "enigma-plan.h"
 
 namespace HPHP {
@@ -45,6 +48,38 @@ public:
 
 typedef std::unique_ptr<AssignmentManager> p_AssignmentManager;
 
+/*
+ * Pool-wide counters; they're updated without locking on the query execution paths.
+ */
+struct PoolStats {
+    /*
+     * Latency distribution with fixed buckets
+     */
+    struct Histogram {
+        const static unsigned BucketCount = 14;
+        // Upper bound of each bucket in microseconds; the last bucket is unbounded
+        static const uint64_t BucketBounds[BucketCount - 1];
+
+        std::atomic<uint64_t> buckets[BucketCount];
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> totalMicros{ 0 };
+
+        Histogram();
+        void record(std::chrono::steady_clock::duration duration);
+        Array toArray() const;
+    };
+
+    std::atomic<uint64_t> enqueued{ 0 };
+    std::atomic<uint64_t> completed{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    std::atomic<uint64_t> planCacheHits{ 0 };
+    std::atomic<uint64_t> planCacheMisses{ 0 };
+    // Time spent in the pool queue before a connection was assigned
+    Histogram queueWaitTime;
+    // Time from connection assignment until the result was received
+    Histogram executionTime;
+};
+
 class Pool {
 public:
     const static unsigned DefaultQueueSize = 50;
@@ -52,6 +87,8 @@ public:
     const static unsigned DefaultPoolSize = 1;
     const static unsigned MaxPoolSize = 100;
     const static ConnectionId InvalidConnectionId = std::numeric_limits<ConnectionId>::max();
+    // Seconds between writes of the plan cache file
+    const static unsigned PlanCacheSaveInterval = 60;
 
     Pool(Array const & connectionOpts, Array const & poolOpts);
     ~Pool();
@@ -59,7 +96,9 @@ public:
     Pool(Pool const &) = delete;
     Pool & operator = (Pool const &) = delete;
 
-    QueryAwait * enqueue(p_Query query, PoolHandle * handle);
+    QueryAwait * enqueue(p_Query query, PoolHandle * handle,
+                         ResultCacheRequest cacheRequest = ResultCacheRequest(),
+                         std::string coalesceKey = std::string());
     void enqueue(QueryAwait * query, PoolHandle * handle);
     void execute(ConnectionId connectionId, QueryAwait * query, PoolHandle * handle);
 
@@ -69,6 +108,42 @@ public:
 
     void createHandle(PoolHandle * handle);
     void releaseHandle(PoolHandle * handle);
+    void savePlanCache();
+
+    /*
+     * Marks the plans prepared by the connection as prepared in the plan registry,
+     * so the other connections of the pool can prepare them as well.
+     */
+    void publishPreparedPlans(Connection & connection);
+
+    inline PlanExecutionCounter & planExecutions() {
+        return planExecutions_;
+    }
+
+    inline PlanRegistry & planRegistry() {
+        return planRegistry_;
+    }
+
+    inline sp_ResultCache const & resultCache() const {
+        return resultCache_;
+    }
+
+    inline ResultCacheListener & resultCacheListener() {
+        return *resultCacheListener_;
+    }
+
+    inline InflightQueries & inflightQueries() {
+        return inflightQueries_;
+    }
+
+    inline PoolStats & stats() {
+        return stats_;
+    }
+
+    /*
+     * Returns the pool statistics and the current state of the queue and connections.
+     */
+    Array getStats();
 
 private:
     struct QueueItem {
@@ -81,22 +156,35 @@ private:
     unsigned poolSize_{ DefaultPoolSize };
     // Number of prepared statements to keep per connection
     unsigned planCacheSize_{ PlanCache::DefaultPlanCacheSize };
+    // Approximate server memory budget for prepared statements per connection (0 = unlimited)
+    size_t planCacheMemory_{ 0 };
+    // Number of executions after which plan cached commands are prepared
+    PlanExecutionCounter planExecutions_;
+    // Statements recently prepared on any connection of the pool
+    PlanRegistry planRegistry_;
+    // File the most frequently used plans are persisted to (persistent pools only)
+    std::string planCacheFile_;
+    std::chrono::steady_clock::time_point nextPlanCacheSave_;
+    Mutex planCacheSaveLock_;
+    // Results of queries that opted in to result caching
+    sp_ResultCache resultCache_;
+    // Connection listening for notifications on the tags of cached results
+    std::unique_ptr<ResultCacheListener> resultCacheListener_;
+    // Queries with coalescing enabled that are currently running
+    InflightQueries inflightQueries_;
+    PoolStats stats_;
     ConnectionId nextConnectionIndex_{ 0 };
     // Queries waiting for execution
     folly::MPMCQueue<QueueItem> queue_;
     folly::MPMCQueue<ConnectionId> idleConnections_;
     std::unordered_map<ConnectionId, sp_Connection> connectionMap_;
-    // Statements we're currently preparing
-    std::unordered_map<ConnectionId, QueueItem> preparing_;
-    // Queries to execute after the statement was prepared
-    std::unordered_map<ConnectionId, p_Query> pendingPrepare_;
     p_AssignmentManager transactionLifetimeManager_;
     // TODO: p_AssignmentManager assignmentManager_;
 
     void addConnection(Pgsql::ConnectionOptions const & options);
     void removeConnection(ConnectionId connectionId);
     void tryExecuteNext();
-    void queryCompleted(ConnectionId connectionId, PoolHandle * handle);
+    void queryCompleted(ConnectionId connectionId, PoolHandle * handle, QueryAwait * query);
 };
 
 typedef std::shared_ptr<Pool> sp_Pool;
@@ -149,8 +237,47 @@ public:
     ~PoolHandle();
 
     void bindConnection();
-    Pgsql::p_ResultResource query(String const & command, Array const & params, unsigned flags);
-    QueryAwait * asyncQuery(String const & command, Array const & params, unsigned flags);
+    /*
+     * Executes the query synchronously. The timestamps of the lifecycle events are recorded to
+     * timings if specified; the first response byte cannot be observed when executing queries synchronously.
+     */
+    Pgsql::p_ResultResource query(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                  unsigned flags, ResultCacheRequest const & cacheRequest = ResultCacheRequest(),
+                                  QueryTimings * timings = nullptr);
+    QueryAwait * asyncQuery(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                            unsigned flags, ResultCacheRequest cacheRequest = ResultCacheRequest());
+
+    /*
+     * Determines whether the result of the query can be served from (and stored in) the result cache.
+     * Only results of read-only statements are cached, and never inside transactions,
+     * as they may see uncommitted changes.
+     */
+    ResultCacheRequest resultCacheRequest(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params,
+                                          unsigned flags, unsigned ttl,
+                                          std::vector<std::string> const & tags) const;
+
+    /*
+     * Returns the cached result of the query, or nullptr on a cache miss.
+     */
+    Pgsql::p_ResultResource cachedResult(ResultCacheRequest const & cacheRequest) const;
+
+    bool inTransaction() const;
+
+    /*
+     * Enables the request-scoped memo of SELECT results.
+     */
+    void setMemoization(bool enabled);
+
+    /*
+     * Returns the key the result of the query is memoized under, or an empty string if
+     * memoization is disabled or the result can't be memoized.
+     * Statements other than SELECT, and queries in transactions, clear the memo.
+     */
+    std::string memoKey(PlanInfo const & planInfo, Pgsql::PreparedParameters const & params, unsigned flags);
+
+    inline sp_QueryMemo const & memo() const {
+        return memo_;
+    }
 
     inline sp_Pool pool() const {
         return pool_;
@@ -164,8 +291,11 @@ private:
     sp_Pool pool_;
     std::unique_ptr<PoolConnectionHandle> connection_;
     TransactionState transaction_;
+    // Results of SELECT queries executed in this request (null if memoization is disabled)
+    sp_QueryMemo memo_;
 
-    Pgsql::p_ResultResource query(sp_Connection connection, String const & command, Array const & params, unsigned flags);
+    Pgsql::p_ResultResource query(sp_Connection connection, PlanInfo const & planInfo,
+                                  Pgsql::PreparedParameters const & params, unsigned flags);
 };
 
 class HHPoolHandle {
@@ -183,6 +313,7 @@ private:
 class QueryInterface {
 public:
     void init(String const & command, Array const & params);
+    void bind(Array const & params);
 
     inline String const & command() {
         return command_;
@@ -193,6 +324,11 @@ public:
     }
 
     inline void setFlags(unsigned flags) {
+        // Bound parameters need to be re-encoded if the parameter format changed
+        if ((flags ^ flags_) & Query::kBinaryParams) {
+            preparedParams_.reset();
+        }
+
         flags_ = flags;
     }
 
@@ -200,10 +336,49 @@ public:
         return flags_;
     }
 
+    /*
+     * Number of seconds results of the query are served from the pool's result cache (0 = disabled)
+     */
+    inline void setResultCacheTtl(unsigned ttl) {
+        resultCacheTtl_ = ttl;
+    }
+
+    inline unsigned resultCacheTtl() const {
+        return resultCacheTtl_;
+    }
+
+    /*
+     * Notification channels that invalidate cached results of the query
+     */
+    inline void setResultCacheTags(std::vector<std::string> tags) {
+        resultCacheTags_ = std::move(tags);
+    }
+
+    inline std::vector<std::string> const & resultCacheTags() const {
+        return resultCacheTags_;
+    }
+
+    /*
+     * Returns the placeholder information of the command.
+     * The command is parsed on first use and reused for all subsequent executions.
+     */
+    PlanInfo const & planInfo();
+
+    /*
+     * Returns the bound parameters in placeholder order, in their wire format.
+     * The conversion is cached until new parameters are bound.
+     */
+    Pgsql::PreparedParameters const & preparedParams();
+
 private:
     String command_;
     Array params_;
     unsigned flags_{0};
+    unsigned resultCacheTtl_{0};
+    std::vector<std::string> resultCacheTags_;
+    std::unique_ptr<PlanInfo> planInfo_;
+    ParameterKeys parameterKeys_;
+    std::unique_ptr<Pgsql::PreparedParameters> preparedParams_;
 };
 
 void registerQueueClasses();
@@ -11,11 +11,23 @@ class Query {
     <<__Native>>
     function __construct(string $command, array $params = []);
 
+    <<__Native>>
+    function bind(array $params) : void;
+
     <<__Native>>
     function enablePlanCache(bool $enabled) : void;
 
+    <<__Native>>
+    function enableResultCache(int $ttl, array $tags = []) : void;
+
+    <<__Native>>
+    function enableCoalescing(bool $enabled) : void;
+
     <<__Native>>
     function setBinary(bool $enabled) : void;
+
+    <<__Native>>
+    function setBinaryParams(bool $enabled) : void;
 }
 
 
@@ -24,14 +36,141 @@ class Pool {
     <<__Native>>
     function bindConnection() : void;
 
+    <<__Native>>
+    function enableMemoization(bool $enabled) : void;
+
     <<__Native>>
     function release() : void;
 
     <<__Native>>
-    function asyncQuery(Query $query) : Awaitable<QueryResult>;
+    function getStats() : array;
 
     <<__Native>>
-    function syncQuery(Query $query) : QueryResult;
+    private function executeAsyncQuery(Query $query) : Awaitable<QueryResult>;
+
+    <<__Native>>
+    private function executeSyncQuery(Query $query) : QueryResult;
+
+    const string LOAD_POSITIONS_COLUMN = '__enigma_load_positions';
+
+    private array $loadBatches = [];
+    private ?(function(Query, array, ?ErrorResult) : void) $traceCallback = null;
+
+    /**
+     * Registers a callback that is called with the query, the lifecycle timestamps
+     * (see QueryResult::getTimings()) and the error (or null if the query succeeded)
+     * of each query executed on this handle. Passing null removes the callback.
+     */
+    public function setTraceCallback(?(function(Query, array, ?ErrorResult) : void) $callback) : void {
+        $this->traceCallback = $callback;
+    }
+
+    public function asyncQuery(Query $query) : Awaitable<QueryResult> {
+        if ($this->traceCallback === null) {
+            return $this->executeAsyncQuery($query);
+        }
+
+        return $this->tracedAsyncQuery($query);
+    }
+
+    public function syncQuery(Query $query) : QueryResult {
+        if ($this->traceCallback === null) {
+            return $this->executeSyncQuery($query);
+        }
+
+        try {
+            $result = $this->executeSyncQuery($query);
+        } catch (ErrorResult $e) {
+            $this->trace($query, $e->getTimings(), $e);
+            throw $e;
+        }
+
+        $this->trace($query, $result->getTimings(), null);
+        return $result;
+    }
+
+    private async function tracedAsyncQuery(Query $query) : Awaitable<QueryResult> {
+        try {
+            $result = await $this->executeAsyncQuery($query);
+        } catch (ErrorResult $e) {
+            $this->trace($query, $e->getTimings(), $e);
+            throw $e;
+        }
+
+        $this->trace($query, $result->getTimings(), null);
+        return $result;
+    }
+
+    private function trace(Query $query, array $timings, ?ErrorResult $error) : void {
+        $callback = $this->traceCallback;
+        if ($callback !== null) {
+            $callback($query, $timings, $error);
+        }
+    }
+
+    /**
+     * Fetches the row of $table where $keyCol equals $key, or null if there is no such row.
+     * Lookups on the same table and column that are issued in the same ASIO tick are
+     * sent to the server as a single "WHERE $keyCol = ANY($1)" query.
+     * Keys are compared by the server, so eg. 1.5 and "1.50" find the same NUMERIC row.
+     */
+    public async function load(string $table, string $keyCol, mixed $key) : Awaitable<?array> {
+        $batchKey = $table . "\0" . $keyCol;
+        if (!array_key_exists($batchKey, $this->loadBatches)) {
+            $batch = new LoadBatch();
+            $this->loadBatches[$batchKey] = $batch;
+            $batch->rows = $this->executeLoadBatch($batchKey, $table, $keyCol, $batch);
+        } else {
+            $batch = $this->loadBatches[$batchKey];
+        }
+
+        $batch->keys[] = $key;
+        $rows = await $batch->rows;
+        $lookupKey = (string)$key;
+        return array_key_exists($lookupKey, $rows) ? $rows[$lookupKey] : null;
+    }
+
+    private async function executeLoadBatch(string $batchKey, string $table, string $keyCol,
+                                            LoadBatch $batch) : Awaitable<array> {
+        // Give the other lookups of the current tick a chance to join the batch
+        await \RescheduleWaitHandle::create(\RescheduleWaitHandle::QUEUE_DEFAULT, 0);
+        unset($this->loadBatches[$batchKey]);
+
+        /*
+         * The decoded key column doesn't necessarily match the PHP key (eg. NUMERIC columns
+         * are returned as "1.50"), so the server reports which of the requested keys each row matched.
+         */
+        $keys = array_values(array_unique($batch->keys));
+        $column = self::quoteIdentifier($keyCol, false);
+        $command = 'select *, array_positions(:keys, ' . $column . ') as "' . self::LOAD_POSITIONS_COLUMN . '"'
+            . ' from ' . self::quoteIdentifier($table, true) . ' where ' . $column . ' = any(:keys)';
+        $result = await $this->asyncQuery(new Query($command, ['keys' => $keys]));
+
+        $rows = [];
+        foreach ($result->fetchArrays() as $row) {
+            $positions = explode(',', trim($row[self::LOAD_POSITIONS_COLUMN], '{}'));
+            unset($row[self::LOAD_POSITIONS_COLUMN]);
+            foreach ($positions as $position) {
+                $rows[(string)$keys[(int)$position - 1]] = $row;
+            }
+        }
+
+        return $rows;
+    }
+
+    private static function quoteIdentifier(string $name, bool $qualified) : string {
+        $parts = $qualified ? explode('.', $name) : [$name];
+        return implode('.', array_map($part ==> '"' . str_replace('"', '""', $part) . '"', $parts));
+    }
+}
+
+
+/**
+ * Point lookups collected by Pool::load() that are executed as a single query
+ */
+final class LoadBatch {
+    public array $keys = [];
+    public ?Awaitable<array> $rows = null;
 }
 
 
@@ -39,6 +178,12 @@ class Pool {
 class ErrorResult extends \Exception {
     <<__Native>>
     public function getMessage() : string;
+
+    /**
+     * Returns the lifecycle timestamps of the failed query; see QueryResult::getTimings().
+     */
+    <<__Native>>
+    public function getTimings() : array;
 }
 
 
@@ -49,6 +194,15 @@ class QueryResult {
 
     <<__Native>>
     public function fetchObjects(string $cls, int $flags = 0, array $constructorArgs = []) : array;
+
+    /**
+     * Returns the monotonic timestamps (in microseconds) of the lifecycle events of the query:
+     * enqueued, assigned (to a connection), sent, first_byte (received), completed and unserialized.
+     * Events that didn't happen or can't be observed (eg. the result was served from a cache,
+     * or the first response byte of synchronous queries) are omitted.
+     */
+    <<__Native>>
+    public function getTimings() : array;
 }
 
 }
@@ -1,44 +1,383 @@
 #include "pgsql-connection.h"
 #include "pgsql-result.h"
+#include "pgsql-parse.h"
 #include "hphp/runtime/base/array-iterator.h"
+#include <cinttypes>
 
 namespace HPHP {
 namespace Pgsql {
 
+namespace {
+
+void appendArrayLiteral(Array const & values, std::string & out);
+
+/*
+ * Appends a quoted and escaped array element to an array literal.
+ */
+void appendQuotedArrayElement(const char * value, size_t length, std::string & out) {
+    out.push_back('"');
+    for (size_t i = 0; i < length; i++) {
+        if (value[i] == '"' || value[i] == '\\') {
+            out.push_back('\\');
+        }
+
+        out.push_back(value[i]);
+    }
+    out.push_back('"');
+}
+
+void appendArrayLiteralElement(Variant const & value, std::string & out) {
+    if (value.isNull()) {
+        out.append("NULL");
+    } else if (value.isArray()) {
+        appendArrayLiteral(value.toArray(), out);
+    } else if (value.isBoolean()) {
+        out.push_back(value.toBoolean() ? 't' : 'f');
+    } else if (value.isInteger() || value.isDouble()) {
+        auto str = value.toString();
+        out.append(str.data(), str.size());
+    } else {
+        auto str = value.toString();
+        appendQuotedArrayElement(str.data(), str.size(), out);
+    }
+}
+
+/*
+ * Builds an array literal (eg. {1,2,"a"}) from the values of a PHP array.
+ * Nested arrays are encoded as additional array dimensions.
+ */
+void appendArrayLiteral(Array const & values, std::string & out) {
+    out.push_back('{');
+    bool first = true;
+    for (ArrayIter value(values); value; ++value) {
+        if (!first) {
+            out.push_back(',');
+        }
+
+        appendArrayLiteralElement(value.second(), out);
+        first = false;
+    }
+    out.push_back('}');
+}
+
+/*
+ * Determines the element type of a PHP array that can be sent as a binary array.
+ * Only one-dimensional arrays where all non-null values are integers, floats,
+ * booleans or strings (but not a mix of them) are sent in binary format.
+ * Returns 0 if the array should be sent as an array literal.
+ */
+Oid binaryArrayElementType(Array const & values) {
+    Oid elementType = 0;
+    for (ArrayIter value(values); value; ++value) {
+        auto element = value.second();
+        Oid type;
+        if (element.isNull()) {
+            continue;
+        } else if (element.isInteger()) {
+            type = kOidInt8;
+        } else if (element.isDouble()) {
+            type = kOidFloat8;
+        } else if (element.isBoolean()) {
+            type = kOidBool;
+        } else if (element.isString()) {
+            type = kOidText;
+        } else {
+            return 0;
+        }
+
+        if (elementType != 0 && elementType != type) {
+            return 0;
+        }
+
+        elementType = type;
+    }
+
+    return elementType;
+}
+
+Oid arrayTypeOf(Oid elementType) {
+    switch (elementType) {
+        case kOidInt8: return kOidInt8Array;
+        case kOidFloat8: return kOidFloat8Array;
+        case kOidBool: return kOidBoolArray;
+        case kOidText: return kOidTextArray;
+        default: return 0;
+    }
+}
+
+Oid elementTypeOf(Oid arrayType) {
+    switch (arrayType) {
+        case kOidInt8Array: return kOidInt8;
+        case kOidFloat8Array: return kOidFloat8;
+        case kOidBoolArray: return kOidBool;
+        case kOidTextArray: return kOidText;
+        default: return 0;
+    }
+}
+
+void appendInt32(int32_t value, std::string & out) {
+    auto encoded = __builtin_bswap32((uint32_t)value);
+    out.append(reinterpret_cast<const char *>(&encoded), sizeof(encoded));
+}
+
+void appendInt64(int64_t value, std::string & out) {
+    auto encoded = __builtin_bswap64((uint64_t)value);
+    out.append(reinterpret_cast<const char *>(&encoded), sizeof(encoded));
+}
+
+void appendFloat64(double value, std::string & out) {
+    uint64_t encoded;
+    memcpy(&encoded, &value, sizeof(encoded));
+    appendInt64((int64_t)encoded, out);
+}
+
+/*
+ * Encodes a one-dimensional PHP array in the binary array format.
+ */
+void appendBinaryArray(Array const & values, Oid elementType, std::string & out) {
+    bool hasNull = false;
+    for (ArrayIter value(values); value; ++value) {
+        hasNull = hasNull || value.second().isNull();
+    }
+
+    appendInt32(1, out);
+    appendInt32(hasNull ? 1 : 0, out);
+    appendInt32(elementType, out);
+    appendInt32(values.size(), out);
+    // pgsql array numbering starts from 1
+    appendInt32(1, out);
+
+    for (ArrayIter value(values); value; ++value) {
+        auto element = value.second();
+        if (element.isNull()) {
+            appendInt32(-1, out);
+        } else if (elementType == kOidInt8) {
+            appendInt32(8, out);
+            appendInt64(element.toInt64(), out);
+        } else if (elementType == kOidFloat8) {
+            appendInt32(8, out);
+            appendFloat64(element.toDouble(), out);
+        } else if (elementType == kOidBool) {
+            appendInt32(1, out);
+            out.push_back(element.toBoolean() ? 1 : 0);
+        } else {
+            auto str = element.toString();
+            appendInt32(str.size(), out);
+            out.append(str.data(), str.size());
+        }
+    }
+}
+
+/*
+ * Converts a binary value produced by PreparedParameters back to its text representation.
+ */
+void appendBinaryAsText(Oid type, const char * value, int length, bool quote, std::string & out) {
+    switch (type) {
+        case kOidInt8:
+            out.append(std::to_string(parseInt64(value)));
+            break;
+
+        case kOidFloat8:
+        {
+            auto number = parseFloat64(value);
+            if (std::isnan(number)) {
+                out.append("NaN");
+            } else if (std::isinf(number)) {
+                out.append(number > 0 ? "Infinity" : "-Infinity");
+            } else {
+                char text[32];
+                out.append(text, snprintf(text, sizeof(text), "%.17g", number));
+            }
+            break;
+        }
+
+        case kOidBool:
+            out.push_back(*value ? 't' : 'f');
+            break;
+
+        case kOidText:
+            if (quote) {
+                appendQuotedArrayElement(value, length, out);
+            } else {
+                out.append(value, length);
+            }
+            break;
+
+        case kOidInt8Array:
+        case kOidFloat8Array:
+        case kOidBoolArray:
+        case kOidTextArray:
+        {
+            auto elementType = elementTypeOf(type);
+            int32_t count = parseInt32(value + 12);
+            value += 20;
+            out.push_back('{');
+            for (int32_t i = 0; i < count; i++) {
+                if (i > 0) {
+                    out.push_back(',');
+                }
+
+                int32_t elementLength = parseInt32(value);
+                value += 4;
+                if (elementLength == -1) {
+                    out.append("NULL");
+                } else {
+                    appendBinaryAsText(elementType, value, elementLength, true, out);
+                    value += elementLength;
+                }
+            }
+            out.push_back('}');
+            break;
+        }
+
+        default:
+            throw EnigmaException(std::string("Cannot convert parameter of type ")
+                                  + std::to_string(type) + " to text");
+    }
+}
+
+}
+
 PreparedParameters::PreparedParameters() {}
 
 PreparedParameters::PreparedParameters(PreparedParameters const & prepared)
-        : paramBuffer_(prepared.paramBuffer_), params_(prepared.params_.size()) {
-    for (unsigned i = 0; i < prepared.params_.size(); i++) {
-        auto ptr = prepared.params_[i];
-        if (ptr == nullptr) {
-            params_[i] = nullptr;
-        } else {
-            params_[i] = ptr - prepared.paramBuffer_.data() + paramBuffer_.data();
+        : paramBuffer_(prepared.paramBuffer_), offsets_(prepared.offsets_), values_(prepared.values_),
+          lengths_(prepared.lengths_), formats_(prepared.formats_), types_(prepared.types_),
+          stringValues_(prepared.stringValues_), binaryMode_(prepared.binaryMode_), binary_(prepared.binary_) {
+    /*
+     * Move string values to the parameter buffer, as the strings of the source
+     * must not be referenced (or released) outside of the request thread.
+     */
+    for (unsigned i = 0; i < offsets_.size(); i++) {
+        if (values_[i] != nullptr && offsets_[i] == std::string::npos) {
+            offsets_[i] = paramBuffer_.size();
+            paramBuffer_.append(values_[i], lengths_[i]);
+            paramBuffer_.push_back('\0');
         }
     }
+
+    updateValuePointers();
+}
+
+PreparedParameters::PreparedParameters(BorrowInit, PreparedParameters const & prepared)
+        : strings_(prepared.strings_), paramBuffer_(prepared.paramBuffer_), offsets_(prepared.offsets_),
+          values_(prepared.values_), lengths_(prepared.lengths_), formats_(prepared.formats_),
+          types_(prepared.types_), stringValues_(prepared.stringValues_), binaryMode_(prepared.binaryMode_),
+          binary_(prepared.binary_) {
+    updateValuePointers();
 }
 
-PreparedParameters::PreparedParameters(Array const & params)
-        : params_((ssize_t)params.size()) {
+/*
+ * Converts parameters to their wire representation.
+ * In binary mode, integers, floats and booleans are sent in the binary format of
+ * int8, float8 and bool respectively; all other values are sent as text with
+ * their type inferred by the server.
+ */
+PreparedParameters::PreparedParameters(Array const & params, bool binary)
+        : offsets_((ssize_t)params.size(), std::string::npos), values_((ssize_t)params.size()),
+          lengths_((ssize_t)params.size()), formats_((ssize_t)params.size()), types_((ssize_t)params.size()),
+          stringValues_((ssize_t)params.size(), false), binaryMode_(binary) {
+    auto strings = std::make_shared<req::vector<String>>();
+    strings->reserve(params.size());
     unsigned i = 0;
-    std::vector<ssize_t> positions((ssize_t)params.size());
     for (ArrayIter param(params); param; ++param, ++i) {
-        if (param.second().isNull()) {
-            positions[i] = std::string::npos;
+        auto value = param.second();
+        if (value.isNull()) {
+            values_[i] = nullptr;
+        } else if (binary && value.isInteger()) {
+            auto encoded = __builtin_bswap64((uint64_t)value.toInt64());
+            appendBinary(i, kOidInt8, reinterpret_cast<const char *>(&encoded), sizeof(encoded));
+        } else if (binary && value.isDouble()) {
+            auto number = value.toDouble();
+            uint64_t encoded;
+            memcpy(&encoded, &number, sizeof(encoded));
+            encoded = __builtin_bswap64(encoded);
+            appendBinary(i, kOidFloat8, reinterpret_cast<const char *>(&encoded), sizeof(encoded));
+        } else if (binary && value.isBoolean()) {
+            char encoded = value.toBoolean() ? 1 : 0;
+            appendBinary(i, kOidBool, &encoded, 1);
+        } else if (value.isArray()) {
+            auto elementType = binary ? binaryArrayElementType(value.toArray()) : 0;
+            std::string encoded;
+            if (elementType != 0) {
+                appendBinaryArray(value.toArray(), elementType, encoded);
+                appendBinary(i, arrayTypeOf(elementType), encoded.data(), encoded.size());
+            } else {
+                appendArrayLiteral(value.toArray(), encoded);
+                appendText(i, encoded.data(), encoded.size());
+            }
         } else {
-            auto str = param.second().toString();
-            auto currentBufferPos = paramBuffer_.size();
-            std::copy(str.c_str(), str.c_str() + str.length() + 1, std::back_inserter(paramBuffer_));
-            positions[i] = currentBufferPos;
+            // HHVM strings are always null-terminated, so they can be passed to libpq as-is
+            strings->push_back(value.toString());
+            values_[i] = strings->back().data();
+            lengths_[i] = strings->back().size();
+            stringValues_[i] = true;
         }
     }
 
-    for (unsigned i = 0; i < positions.size(); i++) {
-        if (positions[i] == std::string::npos) {
-            params_[i] = nullptr;
-        } else {
-            params_[i] = paramBuffer_.data() + positions[i];
+    strings_ = std::move(strings);
+    updateValuePointers();
+}
+
+void PreparedParameters::conformTo(std::vector<Oid> const & declaredTypes) {
+    if (!binaryMode_) {
+        return;
+    }
+
+    bool changed = false;
+    for (unsigned i = 0; i < values_.size(); i++) {
+        auto declaredType = i < declaredTypes.size() ? declaredTypes[i] : 0;
+        if (values_[i] == nullptr || declaredType == types_[i]) {
+            continue;
+        }
+
+        if (formats_[i] == 0) {
+            if (declaredType == kOidBytea && stringValues_[i]) {
+                formats_[i] = 1;
+                types_[i] = kOidBytea;
+                binary_ = true;
+            }
+
+            continue;
+        }
+
+        std::string text;
+        appendBinaryAsText(types_[i], paramBuffer_.data() + offsets_[i], lengths_[i], false, text);
+        appendText(i, text.data(), text.size());
+        changed = true;
+    }
+
+    if (changed) {
+        updateValuePointers();
+    }
+}
+
+void PreparedParameters::appendText(unsigned index, const char * value, size_t length) {
+    offsets_[index] = paramBuffer_.size();
+    paramBuffer_.append(value, length);
+    // Text parameters are passed as null-terminated strings to libpq
+    paramBuffer_.push_back('\0');
+    lengths_[index] = length;
+    formats_[index] = 0;
+    types_[index] = 0;
+}
+
+void PreparedParameters::appendBinary(unsigned index, Oid type, const char * value, size_t length) {
+    offsets_[index] = paramBuffer_.size();
+    paramBuffer_.append(value, length);
+    lengths_[index] = length;
+    formats_[index] = 1;
+    types_[index] = type;
+    binary_ = true;
+}
+
+/*
+ * Points values stored in the parameter buffer to the current buffer location.
+ */
+void PreparedParameters::updateValuePointers() {
+    for (unsigned i = 0; i < offsets_.size(); i++) {
+        if (offsets_[i] != std::string::npos) {
+            values_[i] = paramBuffer_.data() + offsets_[i];
         }
     }
 }
@@ -149,6 +488,20 @@ Variant ConnectionResource::parameterStatus(String const & param) const {
     }
 }
 
+/**
+ * Returns the current TimeZone setting of the server.
+ */
+std::shared_ptr<std::string const> ConnectionResource::serverTimezone() {
+    auto timezone = PQparameterStatus(connection_, "TimeZone");
+    if (timezone == nullptr) {
+        serverTimezone_.reset();
+    } else if (!serverTimezone_ || *serverTimezone_ != timezone) {
+        serverTimezone_ = std::make_shared<std::string const>(timezone);
+    }
+
+    return serverTimezone_;
+}
+
 /**
  * Returns the error message most recently generated by an operation on the connection.
  */
@@ -185,7 +538,20 @@ p_ResultResource ConnectionResource::query(String const & command) {
         throw EnigmaException(std::string("Failed to execute query: ") + errorMessage());
     }
 
-    return p_ResultResource(new ResultResource(result));
+    return p_ResultResource(new ResultResource(result, serverTimezone()));
+}
+
+/**
+ * Submits a command to the server and waits for the result, without using request memory.
+ */
+p_ResultResource ConnectionResource::execute(std::string const & command) {
+    ENIG_DEBUG("PQexec()");
+    auto result = PQexec(connection_, command.c_str());
+    if (result == nullptr) {
+        throw EnigmaException(std::string("Failed to execute query: ") + errorMessage());
+    }
+
+    return p_ResultResource(new ResultResource(result, serverTimezone()));
 }
 
 /**
@@ -193,25 +559,27 @@ p_ResultResource ConnectionResource::query(String const & command) {
  */
 p_ResultResource ConnectionResource::queryParams(String const & command, PreparedParameters const & params, bool binary) {
     ENIG_DEBUG("PQsendQueryParams()");
-    auto result = PQexecParams(connection_, command.c_str(), params.count(), nullptr, params.buffer(), nullptr, nullptr, binary ? 1 : 0);
+    auto result = PQexecParams(connection_, command.c_str(), params.count(), params.typeBuffer(), params.buffer(),
+                               params.lengths(), params.formats(), binary ? 1 : 0);
     if (result == nullptr) {
         throw EnigmaException(std::string("Failed to execute query: ") + errorMessage());
     }
 
-    return p_ResultResource(new ResultResource(result));
+    return p_ResultResource(new ResultResource(result, serverTimezone()));
 }
 
 /**
  * Submits a request to create a prepared statement with the given parameters, and waits for completion.
  */
-p_ResultResource ConnectionResource::prepare(String const & stmtName, String const & command, int numParams) {
+p_ResultResource ConnectionResource::prepare(String const & stmtName, String const & command, int numParams,
+                                             const Oid * paramTypes) {
     ENIG_DEBUG("PQsendPrepare()");
-    auto result = PQprepare(connection_, stmtName.c_str(), command.c_str(), numParams, nullptr);
+    auto result = PQprepare(connection_, stmtName.c_str(), command.c_str(), numParams, paramTypes);
     if (result == nullptr) {
         throw EnigmaException(std::string("Failed to prepare statement: ") + errorMessage());
     }
 
-    return p_ResultResource(new ResultResource(result));
+    return p_ResultResource(new ResultResource(result, serverTimezone()));
 }
 
 /**
@@ -219,12 +587,13 @@ p_ResultResource ConnectionResource::prepare(String const & stmtName, String con
  */
 p_ResultResource ConnectionResource::queryPrepared(String const & stmtName, PreparedParameters const & params, bool binary) {
     ENIG_DEBUG("PQsendQueryPrepared()");
-    auto result = PQexecPrepared(connection_, stmtName.c_str(), params.count(), params.buffer(), nullptr, nullptr, binary ? 1 : 0);
+    auto result = PQexecPrepared(connection_, stmtName.c_str(), params.count(), params.buffer(),
+                                 params.lengths(), params.formats(), binary ? 1 : 0);
     if (result == nullptr) {
         throw EnigmaException(std::string("Failed to execute prepared query: ") + errorMessage());
     }
 
-    return p_ResultResource(new ResultResource(result));
+    return p_ResultResource(new ResultResource(result, serverTimezone()));
 }
 
 /**
@@ -237,7 +606,7 @@ p_ResultResource ConnectionResource::describePrepared(String const & stmtName) {
         throw EnigmaException(std::string("Failed to describe prepared statement: ") + errorMessage());
     }
 
-    return p_ResultResource(new ResultResource(result));
+    return p_ResultResource(new ResultResource(result, serverTimezone()));
 }
 
 /**
@@ -255,7 +624,8 @@ void ConnectionResource::sendQuery(String const & command) {
  */
 void ConnectionResource::sendQueryParams(String const & command, PreparedParameters const & params, bool binary) {
     ENIG_DEBUG("PQsendQueryParams()");
-    if (PQsendQueryParams(connection_, command.c_str(), params.count(), nullptr, params.buffer(), nullptr, nullptr, binary ? 1 : 0) != 1) {
+    if (PQsendQueryParams(connection_, command.c_str(), params.count(), params.typeBuffer(), params.buffer(),
+                          params.lengths(), params.formats(), binary ? 1 : 0) != 1) {
         throw EnigmaException(std::string("Failed to send query: ") + errorMessage());
     }
 }
@@ -263,9 +633,10 @@ void ConnectionResource::sendQueryParams(String const & command, PreparedParamet
 /**
  * Sends a request to create a prepared statement with the given parameters, without waiting for completion.
  */
-void ConnectionResource::sendPrepare(String const & stmtName, String const & command, int numParams) {
+void ConnectionResource::sendPrepare(String const & stmtName, String const & command, int numParams,
+                                     const Oid * paramTypes) {
     ENIG_DEBUG("PQsendPrepare()");
-    if (PQsendPrepare(connection_, stmtName.c_str(), command.c_str(), numParams, nullptr) != 1) {
+    if (PQsendPrepare(connection_, stmtName.c_str(), command.c_str(), numParams, paramTypes) != 1) {
         throw EnigmaException(std::string("Failed to prepare statement: ") + errorMessage());
     }
 }
@@ -275,7 +646,8 @@ void ConnectionResource::sendPrepare(String const & stmtName, String const & com
  */
 void ConnectionResource::sendQueryPrepared(String const & stmtName, PreparedParameters const & params, bool binary) {
     ENIG_DEBUG("PQsendQueryPrepared()");
-    if (PQsendQueryPrepared(connection_, stmtName.c_str(), params.count(), params.buffer(), nullptr, nullptr, binary ? 1 : 0) != 1) {
+    if (PQsendQueryPrepared(connection_, stmtName.c_str(), params.count(), params.buffer(),
+                            params.lengths(), params.formats(), binary ? 1 : 0) != 1) {
         throw EnigmaException(std::string("Failed to send prepared query: ") + errorMessage());
     }
 }
@@ -320,8 +692,22 @@ std::unique_ptr<ResultResource> ConnectionResource::getResult() {
         }
 
         return std::unique_ptr<ResultResource>(
-                new ResultResource(result));
+                new ResultResource(result, serverTimezone()));
+    }
+}
+
+/**
+ * Waits for all results of a command that contains multiple statements, and returns them.
+ */
+std::vector<std::unique_ptr<ResultResource>> ConnectionResource::getResults() {
+    ENIG_DEBUG("PQgetResult() - all results");
+    std::vector<std::unique_ptr<ResultResource>> results;
+    while (auto result = PQgetResult(connection_)) {
+        results.push_back(std::unique_ptr<ResultResource>(
+                new ResultResource(result, serverTimezone())));
     }
+
+    return results;
 }
 
 /**
@@ -370,6 +756,20 @@ void ConnectionResource::cancel() {
     }
 }
 
+/**
+ * Returns the channel names of the notifications received since the last call.
+ */
+std::vector<std::string> ConnectionResource::notifies() {
+    std::vector<std::string> channels;
+    PGnotify * notify;
+    while ((notify = PQnotifies(connection_)) != nullptr) {
+        channels.push_back(notify->relname);
+        PQfreemem(notify);
+    }
+
+    return channels;
+}
+
 /**
  * Convert an array to a list of raw (const char *) strings.
  * The string vectors must be preallocated to hold at least [values.length()] elements.
@@ -389,8 +789,9 @@ void ConnectionResource::arrayToStringList(Array const & values, req::vector<Str
 
 void ConnectionResource::beginConnection(ConnectionOptions const & params, ConnectionInit initType) {
     ssize_t n_params = params.size();
-    req::vector<std::string> keys(n_params), values(n_params);
-    req::vector<const char *> pg_keys(n_params + 1), pg_values(n_params + 1);
+    // Connections may be opened outside of request threads, so no request memory is used here
+    std::vector<std::string> keys(n_params), values(n_params);
+    std::vector<const char *> pg_keys(n_params + 1), pg_values(n_params + 1);
 
     unsigned i = 0;
     for (auto it = params.begin(); it != params.end(); ++it, ++i) {
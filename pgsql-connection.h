@@ -20,21 +20,83 @@ typedef std::unique_ptr<ResultResource> p_ResultResource;
 
 class PreparedParameters {
 public:
+    struct BorrowInit {};
+
     PreparedParameters();
+    /*
+     * Copies the parameters, including the string values, so the copy can be passed
+     * to the pool and destroyed on another thread.
+     */
     PreparedParameters(PreparedParameters const & prepared);
-    PreparedParameters(Array const & params);
+    /*
+     * Copies the parameters without copying string values; the copy references the
+     * strings of the source. Only usable for queries executed synchronously in the request thread.
+     */
+    PreparedParameters(BorrowInit, PreparedParameters const & prepared);
+    PreparedParameters(Array const & params, bool binary = false);
 
     inline int count() const {
-        return params_.size();
+        return values_.size();
     }
 
     inline const char * const * buffer() const {
-        return params_.data();
+        return values_.data();
+    }
+
+    /*
+     * Parameter lengths, formats and types are only passed to libpq if at least
+     * one parameter was encoded in binary format.
+     */
+    inline const int * lengths() const {
+        return binary_ ? lengths_.data() : nullptr;
+    }
+
+    inline const int * formats() const {
+        return binary_ ? formats_.data() : nullptr;
+    }
+
+    inline const Oid * typeBuffer() const {
+        return binary_ ? types_.data() : nullptr;
     }
 
+    /*
+     * Type OIDs of each parameter; 0 for parameters where the type should be inferred by the server.
+     */
+    inline req::vector<Oid> const & types() const {
+        return types_;
+    }
+
+    /*
+     * Re-encodes binary parameters whose type differs from the declared parameter types
+     * of a prepared statement in text format, so the server can coerce them.
+     * In binary mode, strings passed to bytea parameters are switched to binary format.
+     */
+    void conformTo(std::vector<Oid> const & declaredTypes);
+
 private:
+    /*
+     * String parameters are not copied; values point directly to the string data,
+     * which is kept alive by this list. The list is shared with borrowed copies.
+     */
+    std::shared_ptr<req::vector<String> const> strings_;
+    // Binary encoded scalars and parameters converted to text
     std::string paramBuffer_;
-    req::vector<const char *> params_;
+    // Offset of each parameter in paramBuffer_, or npos for null and string values
+    req::vector<size_t> offsets_;
+    req::vector<const char *> values_;
+    req::vector<int> lengths_;
+    req::vector<int> formats_;
+    req::vector<Oid> types_;
+    // Whether each parameter was passed as a string
+    req::vector<bool> stringValues_;
+    // Encode parameters in binary format where possible
+    bool binaryMode_{false};
+    // At least one parameter was encoded in binary format
+    bool binary_{false};
+
+    void appendText(unsigned index, const char * value, size_t length);
+    void appendBinary(unsigned index, Oid type, const char * value, size_t length);
+    void updateValuePointers();
 };
 
 enum class ConnectionInit {
@@ -111,6 +173,13 @@ public:
      */
     Variant parameterStatus(String const & param) const;
 
+    /**
+     * Returns the current TimeZone setting of the server.
+     * The value is tracked by libpq from ParameterStatus messages; the returned
+     * string is only reallocated when the server reports a different timezone.
+     */
+    std::shared_ptr<std::string const> serverTimezone();
+
     /**
      * Returns the error message most recently generated by an operation on the connection.
      */
@@ -131,6 +200,12 @@ public:
      */
     p_ResultResource query(String const & command);
 
+    /**
+     * Submits a command to the server and waits for the result.
+     * Doesn't allocate request memory, so it can be used outside of request threads.
+     */
+    p_ResultResource execute(std::string const & command);
+
     /**
      * Submits a command to the server and waits for the result, with the ability to pass parameters separately from the SQL command text.
      */
@@ -139,7 +214,8 @@ public:
     /**
      * Submits a request to create a prepared statement with the given parameters, and waits for completion.
      */
-    p_ResultResource prepare(String const & stmtName, String const & command, int numParams);
+    p_ResultResource prepare(String const & stmtName, String const & command, int numParams,
+                             const Oid * paramTypes = nullptr);
 
     /**
      * Sends a request to execute a prepared statement with given parameters, and waits for the result.
@@ -164,7 +240,8 @@ public:
     /**
      * Sends a request to create a prepared statement with the given parameters, without waiting for completion.
      */
-    void sendPrepare(String const & stmtName, String const & command, int numParams);
+    void sendPrepare(String const & stmtName, String const & command, int numParams,
+                     const Oid * paramTypes = nullptr);
 
     /**
      * Sends a request to execute a prepared statement with given parameters, without waiting for the result(s).
@@ -183,6 +260,12 @@ public:
      */
     std::unique_ptr<ResultResource> getResult();
 
+    /**
+     * Waits for all results of a command that contains multiple statements, and returns them.
+     * (Statements after the first failed statement are not executed and have no result)
+     */
+    std::vector<std::unique_ptr<ResultResource>> getResults();
+
     /**
      * If input is available from the server, consume it.
      *
@@ -199,12 +282,19 @@ public:
 
     void cancel();
 
-    // TODO: notifies
+    /**
+     * Returns the channel names of the notifications received since the last call.
+     * Notifications are only read from the socket by consumeInput() and by commands
+     * executed on the connection.
+     */
+    std::vector<std::string> notifies();
+
     // TODO: copy
     // TODO: notice processing
 
 private:
     PGconn *connection_{nullptr};
+    std::shared_ptr<std::string const> serverTimezone_;
 
     /**
      * Convert an array to a list of raw (const char *) strings.
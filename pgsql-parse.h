@@ -4,12 +4,16 @@
 #include "hphp/runtime/ext/json/ext_json.h"
 #include "hphp/runtime/ext/datetime/ext_datetime.h"
 #include "hphp/runtime/vm/native-data.h"
+#include <arpa/inet.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace HPHP {
 namespace Pgsql {
 
 
-long fast_atol(const char *str, int len) {
+inline long fast_atol(const char *str, int len) {
     long value = 0;
     long sign = 1;
     if (str[0] == '-') {
@@ -54,18 +58,26 @@ enum TypeOid {
     kOidChar = 18,
     kOidInt8 = 20,
     kOidInt2 = 21,
+    kOidInt2Vector = 22,
     kOidInt4 = 23,
     kOidText = 25,
     kOidOid = 26,
     kOidXid = 28,
     kOidCid = 29,
+    kOidOidVector = 30,
     kOidJson = 114,
     kOidXml = 142,
     kOidXmlArray = 143,
     kOidJsonArray = 199,
+    kOidCidr = 650,
+    kOidCidrArray = 651,
     kOidFloat4 = 700,
     kOidFloat8 = 701,
     kOidUnknown = 705,
+    kOidMoney = 790,
+    kOidMoneyArray = 791,
+    kOidMacaddr = 829,
+    kOidInet = 869,
     kOidBoolArray = 1000,
     kOidCharArray = 1002,
     kOidInt2Array = 1005,
@@ -76,6 +88,9 @@ enum TypeOid {
     kOidInt8Array = 1016,
     kOidFloat4Array = 1021,
     kOidFloat8Array = 1022,
+    kOidOidArray = 1028,
+    kOidMacaddrArray = 1040,
+    kOidInetArray = 1041,
     kOidBpchar = 1042,
     kOidVarchar = 1043,
     kOidDate = 1082,
@@ -83,12 +98,23 @@ enum TypeOid {
     kOidTimestamp = 1114,
     kOidTimestampArray = 1115,
     kOidDateArray = 1182,
+    kOidTimeArray = 1183,
     kOidTimestamptz = 1184,
     kOidTimestamptzArray = 1185,
     kOidInterval = 1186,
+    kOidIntervalArray = 1187,
     kOidNumericArray = 1231,
+    kOidTimetz = 1266,
+    kOidTimetzArray = 1270,
+    kOidBit = 1560,
+    kOidBitArray = 1561,
+    kOidVarbit = 1562,
+    kOidVarbitArray = 1563,
     kOidNumeric = 1700,
-    kOidUuid = 2950
+    kOidUuid = 2950,
+    kOidUuidArray = 2951,
+    kOidJsonb = 3802,
+    kOidJsonbArray = 3807
 };
 
 inline int16_t parseInt16(const char * value)
@@ -124,13 +150,13 @@ inline double parseFloat64(const char * value)
 }
 
 template<Oid Ty, bool Binary>
-Variant parseValue(const char * value, int length, uint32_t flags) = delete;
+Variant parseValue(const char * value, int length, ParseContext & ctx) = delete;
 
 #define PG_BINARY_PARSER(ty) template<> \
-    inline Variant parseValue<kOid##ty, true>(const char * value, int length, uint32_t flags)
+    inline Variant parseValue<kOid##ty, true>(const char * value, int length, ParseContext & ctx)
 
 #define PG_TEXT_PARSER(ty) template<> \
-    inline Variant parseValue<kOid##ty, false>(const char * value, int length, uint32_t flags)
+    inline Variant parseValue<kOid##ty, false>(const char * value, int length, ParseContext & ctx)
 
 #define PG_PARSE_STRING { return String(value, (size_t) length, CopyStringMode{}); }
 
@@ -187,37 +213,81 @@ PG_BINARY_PARSER(Float8)
     return Variant(parseFloat64(value));
 }
 
-const StaticString
-    s_DateTimeFormat("U.u"),
-    s_DateFormat("Y-m-d H:i:s");
+const char HexDigits[] = "0123456789abcdef";
 
-inline Variant parseBinaryTimestamp(const char * value, uint32_t flags)
+inline char * formatHexByte(char * out, uint8_t byte)
 {
-    int64_t time = parseInt64(value);
-    // Number of microseconds between 1970-01-01 and 2000-01-01
-    time += 946684800000000l;
-
-    // Convert to "epoch.microseconds" format
-    char ts[32];
-    sprintf(ts, "%ld.%ld", time / 1000000, time % 1000000);
-    String tss(ts, CopyStringMode{});
-    auto cls = DateTimeData::getClass();
-    Variant dt = HHVM_STATIC_MN(DateTime, createFromFormat)(
-            cls, s_DateTimeFormat, tss, init_null_variant);
-    if (!dt.isObject()) {
-        return init_null_variant;
-    }
-
-    Object datetime(dt.toObject());
-    if (flags & ResultResource::kNativeDateTime) {
-        return datetime;
-    } else {
-        return HHVM_MN(DateTime, format)(datetime.get(), s_DateFormat);
+    out[0] = HexDigits[byte >> 4];
+    out[1] = HexDigits[byte & 0x0f];
+    return out + 2;
+}
+
+inline char * formatTwoDigits(char * out, unsigned value)
+{
+    out[0] = '0' + (value / 10) % 10;
+    out[1] = '0' + value % 10;
+    return out + 2;
+}
+
+/*
+ * Appends the seconds part of a time value, omitting trailing zeros
+ * of the fractional part (same as AppendSeconds() in the server)
+ */
+inline char * formatSeconds(char * out, unsigned seconds, unsigned microseconds)
+{
+    out = formatTwoDigits(out, seconds);
+    if (microseconds != 0) {
+        *out++ = '.';
+        char * end = out + 6;
+        for (char * digit = end - 1; digit >= out; digit--) {
+            *digit = '0' + microseconds % 10;
+            microseconds /= 10;
+        }
+
+        while (end[-1] == '0') {
+            end--;
+        }
+
+        out = end;
     }
+
+    return out;
+}
+
+inline char * formatTime(char * out, int64_t time)
+{
+    const int64_t usecsPerHour = 3600000000l;
+    out = formatTwoDigits(out, (unsigned)(time / usecsPerHour));
+    time %= usecsPerHour;
+    *out++ = ':';
+    out = formatTwoDigits(out, (unsigned)(time / 60000000l));
+    time %= 60000000l;
+    *out++ = ':';
+    return formatSeconds(out, (unsigned)(time / 1000000), (unsigned)(time % 1000000));
 }
 
+/*
+ * Zone offsets are sent in seconds west of UTC
+ */
+inline char * formatTimezone(char * out, int32_t zone)
+{
+    *out++ = (zone <= 0) ? '+' : '-';
+    unsigned offset = (unsigned)std::abs(zone);
+    out = formatTwoDigits(out, offset / 3600);
+    if (offset % 60 != 0) {
+        *out++ = ':';
+        out = formatTwoDigits(out, (offset / 60) % 60);
+        *out++ = ':';
+        out = formatTwoDigits(out, offset % 60);
+    } else if ((offset / 60) % 60 != 0) {
+        *out++ = ':';
+        out = formatTwoDigits(out, (offset / 60) % 60);
+    }
+
+    return out;
+}
 
-void
+inline void
 j2date(int jd, int *year, int *month, int *day)
 {
     unsigned int julian;
@@ -244,38 +314,209 @@ j2date(int jd, int *year, int *month, int *day)
     return;
 }   /* j2date() */
 
+inline int
+date2j(int y, int m, int d)
+{
+    int         julian;
+    int         century;
+
+    if (m > 2)
+    {
+        m += 1;
+        y += 4800;
+    }
+    else
+    {
+        m += 13;
+        y += 4799;
+    }
+
+    century = y / 100;
+    julian = y * 365 - 32167;
+    julian += y / 4 - century + century / 4;
+    julian += 7834 * m / 256 + d;
+
+    return julian;
+}   /* date2j() */
+
 const unsigned POSTGRES_EPOCH_JDATE = 2451545;
+// Number of seconds between 1970-01-01 and 2000-01-01
+const int64_t POSTGRES_EPOCH_UNIX_SECONDS = 946684800l;
+const int64_t USECS_PER_DAY = 86400000000l;
 
-PG_BINARY_PARSER(Date)
+/*
+ * Broken-down representation of a DATE or TIMESTAMP value
+ */
+struct DateTimeFields {
+    int year;
+    int month;
+    int day;
+    int hour{0};
+    int minute{0};
+    int second{0};
+    int microsecond{0};
+};
+
+inline void splitDate(int32_t date, DateTimeFields & fields)
 {
-    int32_t date = parseInt32(value);
-    int year, month, day;
-    j2date(date + POSTGRES_EPOCH_JDATE, &year, &month, &day);
+    j2date(date + POSTGRES_EPOCH_JDATE, &fields.year, &fields.month, &fields.day);
+}
+
+/*
+ * Splits a timestamp (number of microseconds since 2000-01-01) into date and time fields
+ */
+inline void splitTimestamp(int64_t time, DateTimeFields & fields)
+{
+    int64_t date = time / USECS_PER_DAY;
+    time -= date * USECS_PER_DAY;
+    if (time < 0) {
+        time += USECS_PER_DAY;
+        date--;
+    }
+
+    splitDate((int32_t)date, fields);
+    fields.hour = (int)(time / 3600000000l);
+    time %= 3600000000l;
+    fields.minute = (int)(time / 60000000l);
+    time %= 60000000l;
+    fields.second = (int)(time / 1000000);
+    fields.microsecond = (int)(time % 1000000);
+}
+
+/*
+ * Formats a date the same way as the server does when using the ISO DateStyle
+ * (eg. "2015-01-01", "0044-03-15 BC")
+ */
+inline char * formatDate(char * out, DateTimeFields const & fields)
+{
+    int year = (fields.year > 0) ? fields.year : -(fields.year - 1);
+    if (year >= 10000) {
+        auto digits = std::to_string(year);
+        memcpy(out, digits.data(), digits.length());
+        out += digits.length();
+    } else {
+        out = formatTwoDigits(out, (unsigned)year / 100);
+        out = formatTwoDigits(out, (unsigned)year % 100);
+    }
+
+    *out++ = '-';
+    out = formatTwoDigits(out, (unsigned)fields.month);
+    *out++ = '-';
+    return formatTwoDigits(out, (unsigned)fields.day);
+}
+
+inline char * formatEra(char * out, DateTimeFields const & fields)
+{
+    if (fields.year <= 0) {
+        memcpy(out, " BC", 3);
+        out += 3;
+    }
+
+    return out;
+}
+
+inline Object makeDateTime(DateTimeFields const & fields, req::ptr<TimeZone> const & timezone)
+{
+    auto dt = req::make<DateTime>(0, timezone);
+    dt->setDate(fields.year, fields.month, fields.day);
+    dt->setTime(fields.hour, fields.minute, fields.second, fields.microsecond);
+    return DateTimeData::wrap(dt);
+}
+
+/*
+ * Creates a DateTime object from a TIMESTAMPTZ value (number of microseconds
+ * since 2000-01-01 00:00:00 UTC) in the specified timezone
+ */
+inline Object makeZonedDateTime(int64_t time, req::ptr<TimeZone> const & timezone)
+{
+    int64_t microseconds = time % 1000000;
+    if (microseconds < 0) {
+        microseconds += 1000000;
+    }
+
+    int64_t seconds = (time - microseconds) / 1000000 + POSTGRES_EPOCH_UNIX_SECONDS;
+    auto dt = req::make<DateTime>(seconds, timezone);
+    if (microseconds != 0) {
+        dt->setTime(dt->hour(), dt->minute(), dt->second(), microseconds);
+    }
+
+    return DateTimeData::wrap(dt);
+}
+
+const int64_t kTimestampInfinity = std::numeric_limits<int64_t>::max();
+const int64_t kTimestampMinusInfinity = std::numeric_limits<int64_t>::min();
+
+inline Variant parseBinaryTimestamp(const char * value, bool withTimezone, ParseContext & ctx)
+{
+    int64_t time = parseInt64(value);
+    if (time == kTimestampInfinity || time == kTimestampMinusInfinity) {
+        if (ctx.flags & ResultResource::kNativeDateTime) {
+            return init_null_variant;
+        } else {
+            return String((time == kTimestampInfinity) ? "infinity" : "-infinity");
+        }
+    }
+
+    if (withTimezone && (ctx.flags & ResultResource::kNativeDateTime)) {
+        return makeZonedDateTime(time, ctx.serverTimezone());
+    }
+
+    /*
+     * TIMESTAMPTZ values are displayed in the current TimeZone of the server,
+     * the same way as the server would send them when using the text protocol
+     */
+    int32_t offset = 0;
+    if (withTimezone) {
+        offset = ctx.serverTimezone()->offset(
+                time / 1000000 + POSTGRES_EPOCH_UNIX_SECONDS);
+        time += (int64_t)offset * 1000000;
+    }
+
+    DateTimeFields fields;
+    splitTimestamp(time, fields);
+    if (ctx.flags & ResultResource::kNativeDateTime) {
+        return makeDateTime(fields, ctx.localTimezone());
+    }
 
-    // Convert to "epoch.microseconds" format
     char ts[64];
-    sprintf(ts, "%d-%02d-%02d", year, month, day);
-    String tss(ts, CopyStringMode{});
+    char * out = formatDate(ts, fields);
+    *out++ = ' ';
+    out = formatTwoDigits(out, (unsigned)fields.hour);
+    *out++ = ':';
+    out = formatTwoDigits(out, (unsigned)fields.minute);
+    *out++ = ':';
+    out = formatSeconds(out, (unsigned)fields.second, (unsigned)fields.microsecond);
+    if (withTimezone) {
+        out = formatTimezone(out, -offset);
+    }
+
+    out = formatEra(out, fields);
+    return String(ts, out - ts, CopyStringMode{});
+}
 
-    if (flags & ResultResource::kNativeDateTime) {
-        auto cls = DateTimeData::getClass();
-        return HHVM_STATIC_MN(DateTime, createFromFormat)(
-                cls, s_DateTimeFormat, tss, init_null_variant);
+PG_BINARY_PARSER(Date)
+{
+    DateTimeFields fields;
+    splitDate(parseInt32(value), fields);
+
+    if (ctx.flags & ResultResource::kNativeDateTime) {
+        return makeDateTime(fields, ctx.localTimezone());
     } else {
-        return tss;
+        char date[32];
+        char * out = formatDate(date, fields);
+        out = formatEra(out, fields);
+        return String(date, out - date, CopyStringMode{});
     }
 }
 
 PG_BINARY_PARSER(Timestamp)
 {
-    return parseBinaryTimestamp(value, flags);
+    return parseBinaryTimestamp(value, false, ctx);
 }
 
 PG_BINARY_PARSER(Timestamptz)
 {
-    // TODO: timezone information is lost when receiving TIMESTAMPTZ
-    // using the binary protocol
-    return parseBinaryTimestamp(value, flags);
+    return parseBinaryTimestamp(value, true, ctx);
 }
 
 PG_BINARY_PARSER(Bytea) PG_PARSE_STRING
@@ -288,13 +529,264 @@ PG_BINARY_PARSER(Varchar) PG_PARSE_STRING
 
 PG_BINARY_PARSER(Json)
 {
-    if (flags & ResultResource::kNativeJson) {
+    if (ctx.flags & ResultResource::kNativeJson) {
         String json(value, (size_t) length, CopyStringMode{});
         return Variant::attach(f_json_decode(json));
     } else
         PG_PARSE_STRING;
 }
 
+PG_BINARY_PARSER(Jsonb)
+{
+    // JSONB values are prefixed with a format version number
+    if (length < 1 || value[0] != 1) {
+        throw EnigmaException("Unsupported JSONB format version");
+    }
+
+    return parseValue<kOidJson, true>(value + 1, length - 1, ctx);
+}
+
+PG_BINARY_PARSER(Uuid)
+{
+    if (length != 16) {
+        throw EnigmaException("Invalid UUID length");
+    }
+
+    String uuid(36, ReserveStringMode{});
+    char * out = uuid.mutableData();
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *out++ = '-';
+        }
+
+        out = formatHexByte(out, (uint8_t)value[i]);
+    }
+
+    uuid.setSize(36);
+    return uuid;
+}
+
+PG_BINARY_PARSER(Time)
+{
+    if (length != 8) {
+        throw EnigmaException("Invalid TIME length");
+    }
+
+    char time[32];
+    char * end = formatTime(time, parseInt64(value));
+    return String(time, end - time, CopyStringMode{});
+}
+
+PG_BINARY_PARSER(Timetz)
+{
+    if (length != 12) {
+        throw EnigmaException("Invalid TIMETZ length");
+    }
+
+    char time[48];
+    char * end = formatTime(time, parseInt64(value));
+    end = formatTimezone(end, parseInt32(value + 8));
+    return String(time, end - time, CopyStringMode{});
+}
+
+inline void appendIntervalPart(std::string & out, int32_t value, const char * unit,
+                               bool & isZero, bool & isBefore)
+{
+    if (value == 0) {
+        return;
+    }
+
+    if (!isZero) {
+        out += ' ';
+    }
+
+    if (isBefore && value > 0) {
+        out += '+';
+    }
+
+    out += std::to_string(value);
+    out += ' ';
+    out += unit;
+    if (value != 1) {
+        out += 's';
+    }
+
+    isBefore = (value < 0);
+    isZero = false;
+}
+
+/*
+ * Intervals are returned using the default ("postgres") IntervalStyle,
+ * eg. "1 year 2 mons 3 days 04:05:06.5"
+ */
+PG_BINARY_PARSER(Interval)
+{
+    if (length != 16) {
+        throw EnigmaException("Invalid INTERVAL length");
+    }
+
+    int64_t time = parseInt64(value);
+    int32_t days = parseInt32(value + 8);
+    int32_t months = parseInt32(value + 12);
+
+    std::string interval;
+    bool isZero = true, isBefore = false;
+    appendIntervalPart(interval, months / 12, "year", isZero, isBefore);
+    appendIntervalPart(interval, months % 12, "mon", isZero, isBefore);
+    appendIntervalPart(interval, days, "day", isZero, isBefore);
+
+    if (isZero || time != 0) {
+        if (!isZero) {
+            interval += ' ';
+        }
+
+        if (time < 0) {
+            interval += '-';
+            time = -time;
+        } else if (isBefore) {
+            interval += '+';
+        }
+
+        const int64_t usecsPerHour = 3600000000l;
+        if (time / usecsPerHour < 10) {
+            interval += '0';
+        }
+
+        interval += std::to_string(time / usecsPerHour);
+
+        char rest[32];
+        char * out = rest;
+        time %= usecsPerHour;
+        *out++ = ':';
+        out = formatTwoDigits(out, (unsigned)(time / 60000000l));
+        time %= 60000000l;
+        *out++ = ':';
+        out = formatSeconds(out, (unsigned)(time / 1000000), (unsigned)(time % 1000000));
+        interval.append(rest, out - rest);
+    }
+
+    return String(interval);
+}
+
+/*
+ * Address family values used by the server (PGSQL_AF_INET, PGSQL_AF_INET6)
+ */
+const uint8_t kPgsqlAfInet = 2;
+const uint8_t kPgsqlAfInet6 = 3;
+
+inline Variant parseBinaryInet(const char * value, int length, bool cidr)
+{
+    if (length < 4) {
+        throw EnigmaException("Not enough bytes for network address header");
+    }
+
+    uint8_t family = (uint8_t)value[0];
+    uint8_t bits = (uint8_t)value[1];
+    uint8_t addressLength = (uint8_t)value[3];
+    if ((family != kPgsqlAfInet || addressLength != 4)
+        && (family != kPgsqlAfInet6 || addressLength != 16)) {
+        throw EnigmaException("Unsupported network address family");
+    }
+
+    if (length != 4 + addressLength) {
+        throw EnigmaException("Invalid network address length");
+    }
+
+    char address[INET6_ADDRSTRLEN + 8];
+    int af = (family == kPgsqlAfInet) ? AF_INET : AF_INET6;
+    if (inet_ntop(af, value + 4, address, INET6_ADDRSTRLEN) == nullptr) {
+        throw EnigmaException("Failed to format network address");
+    }
+
+    size_t addressEnd = strlen(address);
+    if (cidr || bits != addressLength * 8) {
+        addressEnd += snprintf(address + addressEnd, 8, "/%u", (unsigned)bits);
+    }
+
+    return String(address, addressEnd, CopyStringMode{});
+}
+
+PG_BINARY_PARSER(Inet)
+{
+    return parseBinaryInet(value, length, false);
+}
+
+PG_BINARY_PARSER(Cidr)
+{
+    return parseBinaryInet(value, length, true);
+}
+
+PG_BINARY_PARSER(Macaddr)
+{
+    if (length != 6) {
+        throw EnigmaException("Invalid MACADDR length");
+    }
+
+    char mac[17];
+    char * out = mac;
+    for (int i = 0; i < 6; i++) {
+        if (i != 0) {
+            *out++ = ':';
+        }
+
+        out = formatHexByte(out, (uint8_t)value[i]);
+    }
+
+    return String(mac, sizeof(mac), CopyStringMode{});
+}
+
+/*
+ * The textual representation of MONEY depends on lc_monetary; when using the
+ * binary protocol, we return the amount as a plain decimal string instead
+ * (assuming 2 fractional digits), or as a float when kNumericAsFloat is set.
+ */
+PG_BINARY_PARSER(Money)
+{
+    if (length != 8) {
+        throw EnigmaException("Invalid MONEY length");
+    }
+
+    int64_t cents = parseInt64(value);
+    if (ctx.flags & ResultResource::kNumericAsFloat) {
+        return Variant(cents / 100.0);
+    }
+
+    uint64_t absCents = cents < 0 ? -(uint64_t)cents : (uint64_t)cents;
+    std::string amount = (cents < 0) ? "-" : "";
+    amount += std::to_string(absCents / 100);
+    amount += '.';
+    amount += (char)('0' + (absCents % 100) / 10);
+    amount += (char)('0' + absCents % 10);
+    return String(amount);
+}
+
+PG_BINARY_PARSER(Varbit)
+{
+    if (length < 4) {
+        throw EnigmaException("Not enough bytes for bit string length");
+    }
+
+    int32_t bits = parseInt32(value);
+    if (bits < 0 || length - 4 < (bits + 7) / 8) {
+        throw EnigmaException("Invalid bit string length");
+    }
+
+    String bitString(bits, ReserveStringMode{});
+    char * out = bitString.mutableData();
+    const uint8_t * data = reinterpret_cast<const uint8_t *>(value + 4);
+    for (int32_t i = 0; i < bits; i++) {
+        out[i] = (data[i >> 3] & (0x80 >> (i & 7))) ? '1' : '0';
+    }
+
+    bitString.setSize(bits);
+    return bitString;
+}
+
+PG_BINARY_PARSER(Bit)
+{
+    return parseValue<kOidVarbit, true>(value, length, ctx);
+}
+
 
 
 
@@ -351,7 +843,7 @@ PG_TEXT_PARSER(Float8)
 
 PG_TEXT_PARSER(Numeric)
 {
-    if (flags & ResultResource::kNumericAsFloat)
+    if (ctx.flags & ResultResource::kNumericAsFloat)
         return Variant(atof(value));
     else
         PG_PARSE_STRING
@@ -359,34 +851,149 @@ PG_TEXT_PARSER(Numeric)
 
 PG_TEXT_PARSER(Json)
 {
-    if (flags & ResultResource::kNativeJson) {
+    if (ctx.flags & ResultResource::kNativeJson) {
         String json(value, (size_t) length, CopyStringMode{});
         return Variant::attach(f_json_decode(json));
     } else
         PG_PARSE_STRING
 }
 
-PG_TEXT_PARSER(Date)
+PG_TEXT_PARSER(Jsonb)
+{
+    return parseValue<kOidJson, false>(value, length, ctx);
+}
+
+inline bool parseDigits(const char * value, int count, int & result)
 {
-    if (flags & ResultResource::kNativeDateTime) {
+    result = 0;
+    for (int i = 0; i < count; i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return false;
+        }
+
+        result = result * 10 + (value[i] - '0');
+    }
+
+    return true;
+}
+
+/*
+ * Parses ISO dates and timestamps without timezone
+ * ("YYYY-MM-DD" and "YYYY-MM-DD HH:MM:SS[.ffffff]").
+ * Returns false if the value is in any other format.
+ */
+inline bool parseIsoDateTime(const char * value, int length, DateTimeFields & fields)
+{
+    if (length < 10
+        || value[4] != '-' || value[7] != '-'
+        || !parseDigits(value, 4, fields.year)
+        || !parseDigits(value + 5, 2, fields.month)
+        || !parseDigits(value + 8, 2, fields.day)) {
+        return false;
+    }
+
+    if (length == 10) {
+        return true;
+    }
+
+    if (length < 19
+        || value[10] != ' ' || value[13] != ':' || value[16] != ':'
+        || !parseDigits(value + 11, 2, fields.hour)
+        || !parseDigits(value + 14, 2, fields.minute)
+        || !parseDigits(value + 17, 2, fields.second)) {
+        return false;
+    }
+
+    if (length == 19) {
+        return true;
+    }
+
+    int fractionDigits = length - 20;
+    if (value[19] != '.' || fractionDigits < 1 || fractionDigits > 6
+        || !parseDigits(value + 20, fractionDigits, fields.microsecond)) {
+        return false;
+    }
+
+    for (int i = fractionDigits; i < 6; i++) {
+        fields.microsecond *= 10;
+    }
+
+    return true;
+}
+
+inline Variant parseTextDateTime(const char * value, int length, ParseContext & ctx)
+{
+    if (ctx.flags & ResultResource::kNativeDateTime) {
+        DateTimeFields fields;
+        if (parseIsoDateTime(value, length, fields)) {
+            return makeDateTime(fields, ctx.localTimezone());
+        }
+
+        // Fall back to the PHP parser for values using a different DateStyle, BC dates, etc.
         String dt(value, (size_t) length, CopyStringMode{});
         return HHVM_FN(date_create)(dt);
     } else
         PG_PARSE_STRING
 }
 
+PG_TEXT_PARSER(Date)
+{
+    return parseTextDateTime(value, length, ctx);
+}
+
 PG_TEXT_PARSER(Timestamp)
 {
-    if (flags & ResultResource::kNativeDateTime) {
-        String dt(value, (size_t) length, CopyStringMode{});
-        return HHVM_FN(date_create)(dt);
-    } else
-        PG_PARSE_STRING
+    return parseTextDateTime(value, length, ctx);
+}
+
+/*
+ * Parses the UTC offset at the end of an ISO TIMESTAMPTZ value
+ * ("+HH", "+HH:MM" or "+HH:MM:SS"), and returns the length of the suffix,
+ * or 0 if the value has no valid offset suffix
+ */
+inline int parseIsoTimezoneSuffix(const char * value, int length, int32_t & offset)
+{
+    // The offset starts after the time part ("YYYY-MM-DD HH:MM:SS")
+    int pos = length - 1;
+    while (pos >= 19 && value[pos] != '+' && value[pos] != '-') {
+        pos--;
+    }
+
+    int suffixLength = length - pos;
+    if (pos < 19 || (suffixLength != 3 && suffixLength != 6 && suffixLength != 9)) {
+        return 0;
+    }
+
+    auto suffix = value + pos;
+    int hours, minutes = 0, seconds = 0;
+    if (!parseDigits(suffix + 1, 2, hours)
+        || (suffixLength >= 6 && (suffix[3] != ':' || !parseDigits(suffix + 4, 2, minutes)))
+        || (suffixLength == 9 && (suffix[6] != ':' || !parseDigits(suffix + 7, 2, seconds)))) {
+        return 0;
+    }
+
+    offset = hours * 3600 + minutes * 60 + seconds;
+    if (suffix[0] == '-') {
+        offset = -offset;
+    }
+
+    return suffixLength;
 }
 
 PG_TEXT_PARSER(Timestamptz)
 {
-    if (flags & ResultResource::kNativeDateTime) {
+    if (ctx.flags & ResultResource::kNativeDateTime) {
+        DateTimeFields fields;
+        int32_t offset;
+        auto suffixLength = parseIsoTimezoneSuffix(value, length, offset);
+        if (suffixLength > 0 && parseIsoDateTime(value, length - suffixLength, fields)) {
+            int64_t date = date2j(fields.year, fields.month, fields.day) - POSTGRES_EPOCH_JDATE;
+            int64_t time = date * USECS_PER_DAY
+                + ((fields.hour * 60 + fields.minute) * 60 + fields.second - offset) * 1000000l
+                + fields.microsecond;
+            return makeZonedDateTime(time, ctx.serverTimezone());
+        }
+
         String dt(value, (size_t) length, CopyStringMode{});
         return f_date_create(dt);
     } else
@@ -396,39 +1003,107 @@ PG_TEXT_PARSER(Timestamptz)
 #undef PG_BINARY_PARSER
 #undef PG_TEXT_PARSER
 
-inline Variant parseBinaryValueOid(const char * value, int length, Oid oid, uint32_t flags);
+inline Variant parseBinaryValueOid(const char * value, int length, Oid oid, ParseContext & ctx);
+
+/*
+ * Maximum number of array dimensions allowed by PostgreSQL (MAXDIM)
+ */
+const int32_t kMaxArrayDimensions = 6;
+
+struct ArrayDimension {
+    int32_t size;
+    int32_t lowerBound;
+};
 
-inline Variant parseBinaryArray(const char * value, int length, uint32_t flags)
+/*
+ * Creates the output array for one array dimension.
+ * Dimensions with the default lower bound (1) are decoded into a packed array,
+ * other dimensions are keyed starting from (lower bound - 1).
+ */
+inline Array makeDimensionArray(ArrayDimension const & dimension)
 {
-    if (length < 12) {
-        throw EnigmaException("Not enough bytes for headers");
+    if (dimension.lowerBound == 1) {
+        return Array::attach(PackedArray::MakeReserve(dimension.size));
+    } else {
+        return Array::Create();
+    }
+}
+
+inline void setDimensionElement(Array & arr, ArrayDimension const & dimension, int32_t index, Variant const & value)
+{
+    if (dimension.lowerBound == 1) {
+        arr.append(value);
+    } else {
+        arr.set((int64_t)index + dimension.lowerBound - 1, value);
     }
+}
 
-    int32_t dimensions = parseInt32(value + 0);
-    /*int32_t hasNull =*/ parseInt32(value + 4);
-    int32_t elementOid = parseInt32(value + 8);
-    value += 12;
-    length -= 12;
+/*
+ * Decodes a run of non-null fixed-width elements without going through the
+ * OID dispatch of parseBinaryValueOid for each element.
+ */
+template <Oid Ty>
+inline void parseFixedWidthElements(Array & arr, const char *& value, int & length, int32_t count,
+                                    int32_t width, ParseContext & ctx)
+{
+    if ((int64_t)length < (int64_t)count * (width + 4)) {
+        throw EnigmaException("Not enough bytes for element data");
+    }
 
-    if (dimensions == 0) {
-        return Array::Create();
-    } else if (dimensions > 1) {
-        throw EnigmaException("Only 1-dimensional arrays are supported");
+    for (int32_t i = 0; i < count; i++) {
+        if (parseInt32(value) != width) {
+            throw EnigmaException("Invalid element length");
+        }
+
+        arr.append(parseValue<Ty, true>(value + 4, width, ctx));
+        value += width + 4;
     }
 
-    if (length < 8) {
-        throw EnigmaException("Not enough bytes for dimension information");
+    length -= count * (width + 4);
+}
+
+#define HANDLE_FIXED_WIDTH(ty, width) case kOid##ty: \
+    parseFixedWidthElements<kOid##ty>(arr, value, length, count, width, ctx); \
+    return true;
+inline bool parseFixedWidthArray(Array & arr, const char *& value, int & length, int32_t count,
+                                 Oid elementOid, ParseContext & ctx)
+{
+    switch (elementOid) {
+        HANDLE_FIXED_WIDTH(Bool, 1)
+        HANDLE_FIXED_WIDTH(Int2, 2)
+        HANDLE_FIXED_WIDTH(Int4, 4)
+        HANDLE_FIXED_WIDTH(Int8, 8)
+        HANDLE_FIXED_WIDTH(Float4, 4)
+        HANDLE_FIXED_WIDTH(Float8, 8)
+        HANDLE_FIXED_WIDTH(Oid, 4)
+
+        default:
+            return false;
     }
+}
+#undef HANDLE_FIXED_WIDTH
 
-    int32_t count = parseInt32(value + 0);
-    int32_t leftBound = parseInt32(value + 4);
-    // pgsql array numbering starts from 1
-    leftBound--;
-    value += 8;
-    length -= 8;
+inline Array parseBinaryArrayDimension(const char *& value, int & length, ArrayDimension const * dimensions,
+                                       int32_t remainingDimensions, Oid elementOid, bool hasNull,
+                                       ParseContext & ctx)
+{
+    auto const & dimension = dimensions[0];
+    Array arr{makeDimensionArray(dimension)};
+    if (remainingDimensions > 1) {
+        for (int32_t i = 0; i < dimension.size; i++) {
+            setDimensionElement(arr, dimension, i, parseBinaryArrayDimension(
+                value, length, dimensions + 1, remainingDimensions - 1, elementOid, hasNull, ctx));
+        }
 
-    Array arr{Array::Create()};
-    for (int i = 0; i < count; i++) {
+        return arr;
+    }
+
+    if (!hasNull && dimension.lowerBound == 1
+        && parseFixedWidthArray(arr, value, length, dimension.size, elementOid, ctx)) {
+        return arr;
+    }
+
+    for (int32_t i = 0; i < dimension.size; i++) {
         if (length < 4) {
             throw EnigmaException("Not enough bytes for element length");
         }
@@ -438,18 +1113,61 @@ inline Variant parseBinaryArray(const char * value, int length, uint32_t flags)
         length -= 4;
         if (elementLength == -1) {
             // Null value
-            arr.set(i + leftBound, init_null());
+            setDimensionElement(arr, dimension, i, init_null());
         } else if (elementLength < 0) {
             throw EnigmaException("Invalid element length");
         } else if (length < elementLength) {
             throw EnigmaException("Not enough bytes for element data");
         } else {
-            arr.set(i + leftBound, parseBinaryValueOid(value, elementLength, elementOid, flags));
+            setDimensionElement(arr, dimension, i, parseBinaryValueOid(value, elementLength, elementOid, ctx));
             value += elementLength;
             length -= elementLength;
         }
     }
 
+    return arr;
+}
+
+inline Variant parseBinaryArray(const char * value, int length, ParseContext & ctx)
+{
+    if (length < 12) {
+        throw EnigmaException("Not enough bytes for headers");
+    }
+
+    int32_t dimensions = parseInt32(value + 0);
+    int32_t hasNull = parseInt32(value + 4);
+    int32_t elementOid = parseInt32(value + 8);
+    value += 12;
+    length -= 12;
+
+    if (dimensions == 0) {
+        return Array::Create();
+    } else if (dimensions < 0 || dimensions > kMaxArrayDimensions) {
+        throw EnigmaException(std::string("Invalid number of array dimensions: ")
+                              + std::to_string(dimensions));
+    }
+
+    if (length < 8 * dimensions) {
+        throw EnigmaException("Not enough bytes for dimension information");
+    }
+
+    ArrayDimension bounds[kMaxArrayDimensions];
+    int64_t elements = 1;
+    for (int32_t i = 0; i < dimensions; i++) {
+        bounds[i].size = parseInt32(value + 0);
+        bounds[i].lowerBound = parseInt32(value + 4);
+        value += 8;
+        length -= 8;
+
+        // Each element takes at least 4 bytes (the element length)
+        elements *= bounds[i].size;
+        if (bounds[i].size < 0 || elements * 4 > length) {
+            throw EnigmaException("Invalid array dimension size");
+        }
+    }
+
+    Array arr{parseBinaryArrayDimension(value, length, bounds, dimensions, elementOid, hasNull != 0, ctx)};
+
     if (length) {
         throw EnigmaException("Stray data at end of array");
     }
@@ -457,16 +1175,40 @@ inline Variant parseBinaryArray(const char * value, int length, uint32_t flags)
     return arr;
 }
 
+/*
+ * INT2VECTOR and OIDVECTOR are sent using the array format;
+ * unless native arrays were requested, they are returned using
+ * their textual representation (eg. "1 2 3")
+ */
+inline Variant parseBinaryVector(const char * value, int length, ParseContext & ctx)
+{
+    auto elements = parseBinaryArray(value, length, ctx);
+    if (ctx.flags & ResultResource::kNativeArrays) {
+        return elements;
+    }
+
+    std::string vec;
+    for (ArrayIter element(elements.toArray()); element; ++element) {
+        if (!vec.empty()) {
+            vec += ' ';
+        }
+
+        vec += std::to_string(element.second().toInt64());
+    }
+
+    return String(vec);
+}
+
 #define HANDLE_ARRAY(ty) case kOid##ty##Array:  \
-    if (flags & ResultResource::kNativeArrays) { \
-        return parseBinaryArray(value, length, flags); \
+    if (ctx.flags & ResultResource::kNativeArrays) { \
+        return parseBinaryArray(value, length, ctx); \
     } else { \
         throw EnigmaException(std::string("Cannot fetch array type as string when using binary protocol: OID ") \
                               + std::to_string(oid)); \
     }
 
-#define HANDLE_TYPE(ty) case kOid##ty: return parseValue<kOid##ty, true>(value, length, flags);
-inline Variant parseBinaryValueOid(const char * value, int length, Oid oid, uint32_t flags)
+#define HANDLE_TYPE(ty) case kOid##ty: return parseValue<kOid##ty, true>(value, length, ctx);
+inline Variant parseBinaryValueOid(const char * value, int length, Oid oid, ParseContext & ctx)
 {
     switch (oid) {
         HANDLE_TYPE(Bool)
@@ -490,24 +1232,52 @@ inline Variant parseBinaryValueOid(const char * value, int length, Oid oid, uint
         HANDLE_TYPE(Bpchar)
         HANDLE_TYPE(Varchar)
         HANDLE_TYPE(Json)
+        HANDLE_TYPE(Jsonb)
+
+        HANDLE_TYPE(Uuid)
+        HANDLE_TYPE(Time)
+        HANDLE_TYPE(Timetz)
+        HANDLE_TYPE(Interval)
+        HANDLE_TYPE(Inet)
+        HANDLE_TYPE(Cidr)
+        HANDLE_TYPE(Macaddr)
+        HANDLE_TYPE(Money)
+        HANDLE_TYPE(Bit)
+        HANDLE_TYPE(Varbit)
+
+        case kOidInt2Vector:
+        case kOidOidVector:
+            return parseBinaryVector(value, length, ctx);
 
         HANDLE_ARRAY(Bool)
         HANDLE_ARRAY(Int2)
         HANDLE_ARRAY(Int4)
         HANDLE_ARRAY(Int8)
+        HANDLE_ARRAY(Oid)
         HANDLE_ARRAY(Float4)
         HANDLE_ARRAY(Float8)
         HANDLE_ARRAY(Numeric)
         HANDLE_ARRAY(Json)
+        HANDLE_ARRAY(Jsonb)
         HANDLE_ARRAY(Date)
+        HANDLE_ARRAY(Time)
+        HANDLE_ARRAY(Timetz)
         HANDLE_ARRAY(Timestamp)
         HANDLE_ARRAY(Timestamptz)
+        HANDLE_ARRAY(Interval)
 
         HANDLE_ARRAY(Xml)
         HANDLE_ARRAY(Char)
         HANDLE_ARRAY(Text)
         HANDLE_ARRAY(Bpchar)
         HANDLE_ARRAY(Varchar)
+        HANDLE_ARRAY(Uuid)
+        HANDLE_ARRAY(Inet)
+        HANDLE_ARRAY(Cidr)
+        HANDLE_ARRAY(Macaddr)
+        HANDLE_ARRAY(Money)
+        HANDLE_ARRAY(Bit)
+        HANDLE_ARRAY(Varbit)
 
         default:
             throw EnigmaException(std::string("Cannot receive type using binary protocol: OID ")
@@ -517,91 +1287,387 @@ inline Variant parseBinaryValueOid(const char * value, int length, Oid oid, uint
 #undef HANDLE_TYPE
 #undef HANDLE_ARRAY
 
-inline Variant parseTextValueOid(const char * value, int length, Oid oid, uint32_t flags);
+/*
+ * Returns whether values of the type are decoded to the same PHP value when
+ * received using the binary protocol as when using the text protocol
+ * (regardless of fetch flags and server settings like DateStyle).
+ */
+inline bool isBinaryTransparentType(Oid oid)
+{
+    switch (oid) {
+        case kOidBool:
+        case kOidInt2:
+        case kOidInt4:
+        case kOidInt8:
+        /*
+         * FLOAT8 is not listed: text values are rounded if extra_float_digits < 1
+         * (the default before PostgreSQL 12), while binary values are exact.
+         */
+        case kOidChar:
+        case kOidText:
+        case kOidXml:
+        case kOidUnknown:
+        case kOidBpchar:
+        case kOidVarchar:
+        case kOidJson:
+        case kOidJsonb:
+            return true;
+
+        default:
+            return false;
+    }
+}
 
-inline Variant parseTextArray(const char * value, int length, Oid elementOid, uint32_t flags)
+inline Variant parseTextValueOid(const char * value, int length, Oid oid, ParseContext & ctx);
+
+/*
+ * Returns a pointer to the first occurrence of either a or b in [value, end),
+ * or end if neither character was found.
+ */
+inline const char * findEither(const char * value, const char * end, char a, char b)
 {
-    auto valueStart = value;
-    if (length < 2) {
-        throw EnigmaException(std::string("Array literal has illegal length: ") + valueStart);
+#if defined(__SSE2__)
+    auto va = _mm_set1_epi8(a);
+    auto vb = _mm_set1_epi8(b);
+    while (end - value >= 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(value));
+        auto matches = _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb));
+        auto mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return value + __builtin_ctz(mask);
+        }
+
+        value += 16;
     }
+#endif
 
-    if (*value != '{') {
-        throw EnigmaException(std::string("Array literal must begin with '{': ") + valueStart);
+    while (value < end && *value != a && *value != b) {
+        value++;
     }
 
-    value++;
-    length--;
+    return value;
+}
+
+inline const char * findChar(const char * value, const char * end, char c)
+{
+    auto found = static_cast<const char *>(memchr(value, c, end - value));
+    return found ? found : end;
+}
+
+/*
+ * Returns the end of a quoted array element (pointer to the closing quote)
+ * and whether the element contains backslash escapes.
+ */
+inline const char * findQuotedElementEnd(const char * value, const char * end, bool & escaped)
+{
+    escaped = false;
+    for (;;) {
+        value = findEither(value, end, '"', '\\');
+        if (value == end) {
+            throw EnigmaException("Unterminated quoted array element");
+        }
 
-    Array arr{Array::Create()};
-    while (*value != '}') {
         if (*value == '"') {
-            value++;
-            length--;
-
-            // TODO: will not be efficient for large arrays!
-            String lit(length, ReserveStringMode{});
-            int litLength = 0;
-            char * litMut = lit.mutableData();
-
-            while (*value != '"') {
-                if (*value == '\\') {
-                    litMut[litLength++] = value[1];
-                    value += 2;
-                    length -= 2;
-                } else {
-                    litMut[litLength++] = *value;
-                    value++;
-                    length--;
+            return value;
+        }
+
+        // The escaped character must be followed by at least the closing quote
+        if (value + 1 >= end) {
+            throw EnigmaException("Unterminated quoted array element");
+        }
+
+        escaped = true;
+        value += 2;
+    }
+}
+
+/*
+ * Copies a quoted array element to the output buffer, removing backslash escapes.
+ */
+inline void unescapeArrayElement(const char * value, const char * end, std::string & out)
+{
+    out.clear();
+    for (;;) {
+        auto escape = findChar(value, end, '\\');
+        out.append(value, escape - value);
+        if (escape == end) {
+            break;
+        }
+
+        out.push_back(escape[1]);
+        value = escape + 2;
+    }
+}
+
+/*
+ * Returns a pointer to the first array structure character (',', '"', '{' or '}')
+ * in [value, end), or end if none was found.
+ */
+inline const char * findArrayDelimiter(const char * value, const char * end)
+{
+#if defined(__SSE2__)
+    auto comma = _mm_set1_epi8(',');
+    auto quote = _mm_set1_epi8('"');
+    auto open = _mm_set1_epi8('{');
+    auto close = _mm_set1_epi8('}');
+    while (end - value >= 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(value));
+        auto matches = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, quote)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, open), _mm_cmpeq_epi8(chunk, close)));
+        auto mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return value + __builtin_ctz(mask);
+        }
+
+        value += 16;
+    }
+#endif
+
+    while (value < end && *value != ',' && *value != '"' && *value != '{' && *value != '}') {
+        value++;
+    }
+
+    return value;
+}
+
+/*
+ * Counts the number of elements in one dimension of an array literal
+ * (the value must not include the enclosing braces)
+ */
+inline unsigned countTextArrayElements(const char * value, const char * end)
+{
+    if (value == end) {
+        return 0;
+    }
+
+    unsigned count = 1;
+    unsigned depth = 0;
+    bool escaped;
+    for (;;) {
+        value = findArrayDelimiter(value, end);
+        if (value == end) {
+            return count;
+        }
+
+        switch (*value) {
+            case ',':
+                if (depth == 0) {
+                    count++;
                 }
-            }
+                value++;
+                break;
 
-            arr.append(parseTextValueOid(lit.c_str(), litLength, elementOid, flags));
+            case '"':
+                value = findQuotedElementEnd(value + 1, end, escaped) + 1;
+                break;
 
-            value++;
-            length--;
-        } else {
-            auto start = value;
-            while (*value != ',' && *value != '}') {
+            case '{':
+                depth++;
                 value++;
-                length--;
-            }
+                break;
+
+            default:
+                depth--;
+                value++;
+                break;
+        }
+    }
+}
 
-            if (start != value) {
-                if (memcmp(start, "NULL", 4) == 0) {
-                    arr.append(Variant(Variant::NullInit{}));
-                } else {
-                    arr.append(parseTextValueOid(start, value - start, elementOid, flags));
+/*
+ * Returns a pointer to the closing brace of the sub-array starting at value.
+ */
+inline const char * findSubArrayEnd(const char * value, const char * end)
+{
+    unsigned depth = 0;
+    bool escaped;
+    for (;;) {
+        value = findArrayDelimiter(value, end);
+        if (value == end) {
+            throw EnigmaException("Unterminated sub-array in array literal");
+        }
+
+        switch (*value) {
+            case '"':
+                value = findQuotedElementEnd(value + 1, end, escaped) + 1;
+                break;
+
+            case '{':
+                depth++;
+                value++;
+                break;
+
+            case '}':
+                if (--depth == 0) {
+                    return value;
                 }
+                value++;
+                break;
+
+            default:
+                value++;
+                break;
+        }
+    }
+}
+
+/*
+ * Parses the optional dimension decoration ("[lower:upper][lower:upper]=")
+ * that precedes arrays with non-default lower bounds.
+ * Returns a pointer to the first character after the decoration.
+ */
+inline const char * parseTextArrayBounds(const char * value, const char * end, std::vector<int32_t> & lowerBounds)
+{
+    while (value < end && *value == '[') {
+        auto colon = findChar(value, end, ':');
+        auto bracket = findChar(value, end, ']');
+        if (colon > bracket || bracket == end) {
+            throw EnigmaException("Malformed array dimension decoration");
+        }
+
+        char * numberEnd;
+        auto lowerBound = strtol(value + 1, &numberEnd, 10);
+        if (numberEnd != colon) {
+            throw EnigmaException("Malformed array dimension decoration");
+        }
+
+        lowerBounds.push_back((int32_t)lowerBound);
+        value = bracket + 1;
+    }
+
+    if (value == end || *value != '=') {
+        throw EnigmaException("Array dimension decoration must be followed by '='");
+    }
+
+    return value + 1;
+}
+
+inline Array parseTextArrayDimension(const char * start, const char * end, unsigned dimension,
+                                     std::vector<int32_t> const & lowerBounds, Oid elementOid,
+                                     ParseContext & ctx)
+{
+    ArrayDimension bounds;
+    bounds.size = countTextArrayElements(start, end);
+    bounds.lowerBound = dimension < lowerBounds.size() ? lowerBounds[dimension] : 1;
+    Array arr{makeDimensionArray(bounds)};
+
+    /*
+     * Elements containing escape sequences are unescaped to the scratch buffer
+     * of the parse context, all other elements are parsed in-place.
+     */
+    auto & scratch = ctx.scratchBuffer();
+    auto pos = start;
+    int32_t index = 0;
+    while (pos < end) {
+        if (*pos == '{') {
+            auto subArrayEnd = findSubArrayEnd(pos, end);
+            setDimensionElement(arr, bounds, index++, parseTextArrayDimension(
+                pos + 1, subArrayEnd, dimension + 1, lowerBounds, elementOid, ctx));
+            pos = subArrayEnd + 1;
+        } else if (*pos == '"') {
+            bool escaped;
+            auto elementEnd = findQuotedElementEnd(pos + 1, end, escaped);
+            if (escaped) {
+                unescapeArrayElement(pos + 1, elementEnd, scratch);
+                setDimensionElement(arr, bounds, index++,
+                    parseTextValueOid(scratch.data(), scratch.length(), elementOid, ctx));
             } else {
-                throw EnigmaException(std::string("Unexpected zero length element in array: ") + valueStart);
+                setDimensionElement(arr, bounds, index++,
+                    parseTextValueOid(pos + 1, elementEnd - pos - 1, elementOid, ctx));
             }
+
+            pos = elementEnd + 1;
+        } else {
+            auto elementEnd = findChar(pos, end, ',');
+            auto elementLength = elementEnd - pos;
+            if (elementLength == 0) {
+                throw EnigmaException(std::string("Unexpected zero length element in array: ")
+                                      + std::string(start, end - start));
+            }
+
+            if (elementLength == 4 && memcmp(pos, "NULL", 4) == 0) {
+                setDimensionElement(arr, bounds, index++, init_null_variant);
+            } else {
+                setDimensionElement(arr, bounds, index++,
+                    parseTextValueOid(pos, elementLength, elementOid, ctx));
+            }
+
+            pos = elementEnd;
         }
 
-        if (*value == ',') {
-            value++;
-            length--;
-        } else if (*value != '}') {
-            throw EnigmaException(std::string("Expected comma after end of element: ") + valueStart);
+        if (pos < end) {
+            if (*pos != ',') {
+                throw EnigmaException(std::string("Expected comma after end of element: ")
+                                      + std::string(start, end - start));
+            }
+
+            if (++pos == end) {
+                throw EnigmaException(std::string("Unexpected zero length element in array: ")
+                                      + std::string(start, end - start));
+            }
         }
     }
 
-    if (length != 1) {
-        throw EnigmaException(std::string("Stray data at end of array: ") + valueStart);
+    return arr;
+}
+
+inline Variant parseTextArray(const char * value, int length, Oid elementOid, ParseContext & ctx)
+{
+    auto start = value;
+    auto end = value + length;
+    std::vector<int32_t> lowerBounds;
+    if (length > 0 && value[0] == '[') {
+        start = parseTextArrayBounds(start, end, lowerBounds);
+    }
+
+    if (end - start < 2) {
+        throw EnigmaException(std::string("Array literal has illegal length: ") + std::string(value, length));
+    }
+
+    if (start[0] != '{' || end[-1] != '}') {
+        throw EnigmaException(std::string("Array literal must be enclosed in '{}': ") + std::string(value, length));
+    }
+
+    return parseTextArrayDimension(start + 1, end - 1, 0, lowerBounds, elementOid, ctx);
+}
+
+/*
+ * Parses the textual representation of INT2VECTOR and OIDVECTOR values (eg. "1 2 3")
+ */
+inline Variant parseTextVector(const char * value, int length, ParseContext & ctx)
+{
+    if (!(ctx.flags & ResultResource::kNativeArrays)) {
+        return String(value, (size_t) length, CopyStringMode{});
+    }
+
+    Array arr{Array::Create()};
+    auto end = value + length;
+    while (value < end) {
+        auto start = value;
+        while (value < end && *value != ' ') {
+            value++;
+        }
+
+        if (value != start) {
+            arr.append(fast_atol(start, value - start));
+        }
+
+        value++;
     }
 
     return arr;
 }
 
 #define HANDLE_ARRAY(ty) case kOid##ty##Array: \
-    if (flags & ResultResource::kNativeArrays) { \
-        return parseTextArray(value, length, kOid##ty, flags); \
+    if (ctx.flags & ResultResource::kNativeArrays) { \
+        return parseTextArray(value, length, kOid##ty, ctx); \
     } else { \
         return String(value, (size_t) length, CopyStringMode{}); \
     }
 
-#define HANDLE_TYPE(ty) case kOid##ty: return parseValue<kOid##ty, false>(value, length, flags);
-inline Variant parseTextValueOid(const char * value, int length, Oid oid, uint32_t flags)
+#define HANDLE_TYPE(ty) case kOid##ty: return parseValue<kOid##ty, false>(value, length, ctx);
+inline Variant parseTextValueOid(const char * value, int length, Oid oid, ParseContext & ctx)
 {
     switch (oid) {
         HANDLE_TYPE(Bool)
@@ -615,27 +1681,44 @@ inline Variant parseTextValueOid(const char * value, int length, Oid oid, uint32
         HANDLE_TYPE(Float8)
         HANDLE_TYPE(Numeric)
         HANDLE_TYPE(Json)
+        HANDLE_TYPE(Jsonb)
         HANDLE_TYPE(Date)
         HANDLE_TYPE(Timestamp)
         HANDLE_TYPE(Timestamptz)
 
+        case kOidInt2Vector:
+        case kOidOidVector:
+            return parseTextVector(value, length, ctx);
+
         HANDLE_ARRAY(Bool)
         HANDLE_ARRAY(Int2)
         HANDLE_ARRAY(Int4)
         HANDLE_ARRAY(Int8)
+        HANDLE_ARRAY(Oid)
         HANDLE_ARRAY(Float4)
         HANDLE_ARRAY(Float8)
         HANDLE_ARRAY(Numeric)
         HANDLE_ARRAY(Json)
+        HANDLE_ARRAY(Jsonb)
         HANDLE_ARRAY(Date)
+        HANDLE_ARRAY(Time)
+        HANDLE_ARRAY(Timetz)
         HANDLE_ARRAY(Timestamp)
         HANDLE_ARRAY(Timestamptz)
+        HANDLE_ARRAY(Interval)
 
         HANDLE_ARRAY(Xml)
         HANDLE_ARRAY(Char)
         HANDLE_ARRAY(Text)
         HANDLE_ARRAY(Bpchar)
         HANDLE_ARRAY(Varchar)
+        HANDLE_ARRAY(Uuid)
+        HANDLE_ARRAY(Inet)
+        HANDLE_ARRAY(Cidr)
+        HANDLE_ARRAY(Macaddr)
+        HANDLE_ARRAY(Money)
+        HANDLE_ARRAY(Bit)
+        HANDLE_ARRAY(Varbit)
 
         default: return String(value, (size_t) length, CopyStringMode{});
     }
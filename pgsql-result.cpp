@@ -6,9 +6,45 @@
 namespace HPHP {
 namespace Pgsql {
 
+const StaticString s_UTC("UTC");
 
-ResultResource::ResultResource(PGresult *result)
-        : result_{result} { }
+ParseContext::ParseContext(uint32_t flags, std::shared_ptr<std::string const> serverTimezoneName)
+        : flags(flags), serverTimezoneName_(std::move(serverTimezoneName)) { }
+
+req::ptr<TimeZone> const & ParseContext::localTimezone() {
+    if (!localTimezone_) {
+        localTimezone_ = TimeZone::Current();
+    }
+
+    return localTimezone_;
+}
+
+req::ptr<TimeZone> const & ParseContext::utcTimezone() {
+    if (!utcTimezone_) {
+        utcTimezone_ = req::make<TimeZone>(s_UTC);
+    }
+
+    return utcTimezone_;
+}
+
+req::ptr<TimeZone> const & ParseContext::serverTimezone() {
+    if (!serverTimezone_) {
+        if (serverTimezoneName_) {
+            auto timezone = req::make<TimeZone>(String(*serverTimezoneName_));
+            if (timezone->isValid()) {
+                serverTimezone_ = timezone;
+                return serverTimezone_;
+            }
+        }
+
+        serverTimezone_ = utcTimezone();
+    }
+
+    return serverTimezone_;
+}
+
+ResultResource::ResultResource(PGresult *result, std::shared_ptr<std::string const> serverTimezone)
+        : result_{result}, serverTimezone_(std::move(serverTimezone)) { }
 
 ResultResource::~ResultResource() {
     if (result_) {
@@ -136,7 +172,7 @@ Variant ResultResource::value(int row, int column) const {
 /**
  * Returns a single field value of one row of the result. Row and column numbers start at 0.
  */
-Variant ResultResource::typedValue(int row, int column, Oid oid, uint32_t flags) const {
+Variant ResultResource::typedValue(int row, int column, Oid oid, ParseContext & context) const {
     if (PQgetisnull(result_, row, column) == 1) {
         return Variant(Variant::NullInit{});
     } else {
@@ -144,9 +180,9 @@ Variant ResultResource::typedValue(int row, int column, Oid oid, uint32_t flags)
         auto length = PQgetlength(result_, row, column);
 
         if (columnBinary(column)) {
-            return parseBinaryValueOid(value, length, oid, flags);
+            return parseBinaryValueOid(value, length, oid, context);
         } else {
-            return parseTextValueOid(value, length, oid, flags);
+            return parseTextValueOid(value, length, oid, context);
         }
     }
 }
@@ -174,6 +210,24 @@ int ResultResource::affectedRows() const {
     }
 }
 
+PGresult * ResultResource::copyTuples() const {
+    return PQcopyResult(result_, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES);
+}
+
+size_t ResultResource::memoryUsage() const {
+    auto rows = PQntuples(result_);
+    auto fields = PQnfields(result_);
+    // Fixed size header, column descriptors and per-value pointers (PGresAttDesc, PGresAttValue)
+    size_t size = 256 + fields * 64 + (size_t)rows * fields * 16;
+    for (int row = 0; row < rows; row++) {
+        for (int field = 0; field < fields; field++) {
+            size += PQgetlength(result_, row, field) + 1;
+        }
+    }
+
+    return size;
+}
+
 
 }
 }
@@ -2,12 +2,57 @@
 #define HPHP_PGSQL_RESOURCE_H
 
 #include "hphp/runtime/ext/extension.h"
+#include "hphp/runtime/base/timezone.h"
 #include <libpq-fe.h>
 #include "enigma-common.h"
 
 namespace HPHP {
 namespace Pgsql {
 
+/**
+ * State shared by value parsers while converting the values of a result set.
+ */
+class ParseContext {
+public:
+    explicit ParseContext(uint32_t flags, std::shared_ptr<std::string const> serverTimezoneName = nullptr);
+
+    /**
+     * Returns the default timezone of the request.
+     * The timezone object is created on first use and reused for all subsequent values.
+     */
+    req::ptr<TimeZone> const & localTimezone();
+
+    /**
+     * Returns the UTC timezone.
+     */
+    req::ptr<TimeZone> const & utcTimezone();
+
+    /**
+     * Returns the TimeZone setting of the server at the time the result was received.
+     * Falls back to UTC if the server did not report its timezone, or if the
+     * timezone is not known to PHP.
+     */
+    req::ptr<TimeZone> const & serverTimezone();
+
+    /**
+     * Returns a buffer that parsers can use for temporary data (eg. unescaped array elements).
+     * The buffer is reused for all values parsed using this context.
+     */
+    inline std::string & scratchBuffer() {
+        return scratch_;
+    }
+
+    // Value conversion flags (see ResultResource::TypedValueOptions)
+    uint32_t flags;
+
+private:
+    std::shared_ptr<std::string const> serverTimezoneName_;
+    req::ptr<TimeZone> localTimezone_;
+    req::ptr<TimeZone> utcTimezone_;
+    req::ptr<TimeZone> serverTimezone_;
+    std::string scratch_;
+};
+
 class ResultResource {
 public:
     enum class Status {
@@ -62,7 +107,7 @@ public:
         kNumericAsFloat = 0x08
     };
 
-    ResultResource(PGresult *result);
+    ResultResource(PGresult *result, std::shared_ptr<std::string const> serverTimezone = nullptr);
 
     ~ResultResource();
 
@@ -130,7 +175,7 @@ public:
     /**
      * Returns a single field value of one row of the result. Row and column numbers start at 0.
      */
-    Variant typedValue(int row, int column, Oid type, unsigned flags) const;
+    Variant typedValue(int row, int column, Oid type, ParseContext & context) const;
 
     /**
      * Returns the number of parameters of a prepared statement.
@@ -144,8 +189,27 @@ public:
 
     int affectedRows() const;
 
+    /**
+     * Returns a copy of the column attributes and rows of the result.
+     * The copy doesn't include the command status and error information of the original.
+     */
+    PGresult * copyTuples() const;
+
+    /**
+     * Returns the approximate amount of memory used by the result.
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * Returns the TimeZone setting of the server when the result was received.
+     */
+    inline std::shared_ptr<std::string const> const & serverTimezone() const {
+        return serverTimezone_;
+    }
+
 private:
     PGresult * result_;
+    std::shared_ptr<std::string const> serverTimezone_;
 };
 
 }
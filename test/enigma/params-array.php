@@ -0,0 +1,12 @@
+<?php
+
+include 'connect.inc';
+
+$sql = 'select x from generate_series(1, 5) x where x = any(?) order by x';
+var_dump(querya($sql, [[2, 4, null]]));
+var_dump(querya($sql, [[2, 4, null]], Enigma\Query::BINARY_PARAMS));
+
+$sql = 'select ?::text[] as t, ?::integer[] as m, cardinality(?::integer[]) as e';
+$params = [['a"b', 'c\\d,', null], [[1, 2], [3, 4]], []];
+var_dump(querya($sql, $params, 0, Enigma\QueryResult::NATIVE));
+var_dump(querya($sql, $params, Enigma\Query::BINARY_PARAMS, Enigma\QueryResult::NATIVE));
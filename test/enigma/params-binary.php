@@ -0,0 +1,14 @@
+<?php
+
+include 'connect.inc';
+
+$params = [1, -9223372036854775807, 1.5, true, false, null, 'text'];
+$sql = 'select pg_typeof(?)::text as i, ? as i2, pg_typeof(?)::text as f, ? as b1, ? as b2, ? as n, ? as t';
+var_dump(querya($sql, $params, Enigma\Query::BINARY_PARAMS));
+
+// Cached plans keep the parameter types of their first execution
+$sql = 'select ? + 1 as a, ?::text as b';
+var_dump(syncQuery($sql, [1, 2.5], Enigma\Query::BINARY_PARAMS | Enigma\Query::CACHE_PLAN)->fetchArrays());
+var_dump(syncQuery($sql, [2, 3.5], Enigma\Query::BINARY_PARAMS | Enigma\Query::CACHE_PLAN)->fetchArrays());
+var_dump(syncQuery($sql, [3, null], Enigma\Query::BINARY_PARAMS | Enigma\Query::CACHE_PLAN)->fetchArrays());
+var_dump(syncQuery($sql, [4, '5'], Enigma\Query::BINARY_PARAMS | Enigma\Query::CACHE_PLAN)->fetchArrays());
@@ -0,0 +1,9 @@
+<?php
+
+include 'connect.inc';
+
+$blob = str_repeat('0123456789abcdef', 256 * 1024);
+$rows = querya('select length(?) as l, md5(?) = ? as same, ? as small', [$blob, $blob, md5($blob), 'abc']);
+var_dump($rows);
+$rows = syncQuery('select length(?) as l', [$blob], Enigma\Query::CACHE_PLAN)->fetchArrays();
+var_dump($rows);
@@ -0,0 +1,16 @@
+<?php
+
+include 'connect.inc';
+
+$rows = querya(<<<'SQL'
+    select :a::integer as a, -- :b ?
+           ':c ?' as b, /* :d /* ? */ */
+           $$ :e ? $$ as c,
+           "?column?" as d,
+           E'\' :f' as e,
+           array[1, 2, 3][2:3] as f,
+           x=:a as g
+    from (select 1 as "?column?", 1 as x) t
+SQL
+, ['a' => 1]);
+var_dump($rows);
@@ -0,0 +1,18 @@
+<?php
+
+$poolOptions = ['pool_size' => 1];
+include 'connect.inc';
+
+for ($i = 1; $i <= 3; $i++) {
+    $rows = querya('select ?::integer * 2 as a', [$i], Enigma\Query::CACHE_PLAN);
+    echo $rows[0]['a'], "\n";
+}
+
+$prepared = querya('select count(*) as c from pg_prepared_statements');
+echo $prepared[0]['c'], "\n";
+
+try {
+    querya('select ?::integer as a from enigma_missing_table', [1], Enigma\Query::CACHE_PLAN);
+} catch (Enigma\ErrorResult $e) {
+    echo trim($e->getMessage()), "\n";
+}
@@ -0,0 +1,28 @@
+<?php
+
+$poolOptions = ['pool_size' => 2, 'plan_cache_size' => 1];
+include 'connect.inc';
+
+// Prepared on the first connection only
+$rows = querya('select ?::integer * 5 as a', [1], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+
+/*
+ * The second connection schedules the plan of the first query for preparation,
+ * then evicts it for the plan of this query before it was prepared.
+ */
+$rows = querya('select ?::integer * 7 as a, pg_backend_pid() as pid', [1], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+$pid = $rows[0]['pid'];
+
+// Evicts the prepared plan of the second connection
+querya('select 1');
+$rows = querya('select ?::integer * 11 as a', [1], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+
+for ($i = 0; $i < 2; $i++) {
+    $rows = querya('select pg_backend_pid() as pid, count(*) as c from pg_prepared_statements');
+    if ($rows[0]['pid'] == $pid) {
+        echo 'prepared: ', $rows[0]['c'], "\n";
+    }
+}
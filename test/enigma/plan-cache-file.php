@@ -0,0 +1,20 @@
+<?php
+
+$planCacheFile = tempnam(sys_get_temp_dir(), 'enigma-plans');
+$command = 'select ?::integer + 1 as a';
+file_put_contents($planCacheFile, "enigma-plans 1\n10 0 " . strlen($command) . "\n" . $command . "\n");
+
+$poolOptions = ['persistent' => true, 'pool_size' => 1, 'plan_cache_file' => $planCacheFile];
+include 'connect.inc';
+
+$pool->bindConnection();
+$prepared = syncQuery('select statement from pg_prepared_statements')->fetchArrays();
+var_dump(count($prepared));
+var_dump(strpos($prepared[0]['statement'], 'select $1::integer + 1 as a') !== false);
+
+$rows = syncQuery($command, [41], Enigma\Query::CACHE_PLAN)->fetchArrays();
+var_dump($rows[0]['a']);
+$prepared = syncQuery('select count(*) as c from pg_prepared_statements')->fetchArrays();
+var_dump($prepared[0]['c']);
+
+unlink($planCacheFile);
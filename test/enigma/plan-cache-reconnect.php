@@ -0,0 +1,44 @@
+<?php
+
+$poolOptions = ['pool_size' => 1];
+include 'connect.inc';
+
+function preparedStatements()
+{
+    return syncQuery('select count(*) as c from pg_prepared_statements')->fetchArrays()[0]['c'];
+}
+
+function terminateBackend()
+{
+    try {
+        syncQuery('select pg_terminate_backend(pg_backend_pid())');
+    } catch (Enigma\ErrorResult $e) {
+        echo 'terminated', "\n";
+    }
+}
+
+for ($i = 1; $i <= 3; $i++) {
+    querya('select ?::integer * 2 as a', [$i], Enigma\Query::CACHE_PLAN);
+}
+
+echo 'prepared: ', preparedStatements(), "\n";
+$pid = get_pg_pid($pool);
+
+// Asynchronous reconnect; the plan is prepared again before the query is sent
+terminateBackend();
+$hits = $pool->getStats()['plan_cache_hits'];
+$rows = querya('select ?::integer * 2 as a', [4], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+echo 'reconnected: ', get_pg_pid($pool) != $pid ? 'yes' : 'no', "\n";
+echo 'plan reused: ', $pool->getStats()['plan_cache_hits'] - $hits, "\n";
+echo 'prepared: ', preparedStatements(), "\n";
+
+// Synchronous reconnect; the plan is prepared again while connecting
+$pid = get_pg_pid($pool);
+terminateBackend();
+$hits = $pool->getStats()['plan_cache_hits'];
+$rows = syncQuery('select ?::integer * 2 as a', [5], Enigma\Query::CACHE_PLAN)->fetchArrays();
+echo $rows[0]['a'], "\n";
+echo 'reconnected: ', get_pg_pid($pool) != $pid ? 'yes' : 'no', "\n";
+echo 'plan reused: ', $pool->getStats()['plan_cache_hits'] - $hits, "\n";
+echo 'prepared: ', preparedStatements(), "\n";
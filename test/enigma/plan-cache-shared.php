@@ -0,0 +1,24 @@
+<?php
+
+$poolOptions = ['pool_size' => 2];
+include 'connect.inc';
+
+// Prepared on the first connection only
+$rows = querya('select ?::integer * 3 as a', [1], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+
+/*
+ * Idle connections are assigned in turn; the statement is prepared on the other
+ * connection ahead of the first query it receives after it was connected.
+ */
+$prepared = [];
+for ($i = 0; $i < 4; $i++) {
+    $rows = querya("select pg_backend_pid() as pid, count(*) as c from pg_prepared_statements
+        where statement like '%::integer * 3 as a%'");
+    $prepared[$rows[0]['pid']] = $rows[0]['c'];
+}
+
+echo 'connections: ', count($prepared), "\n";
+foreach ($prepared as $count) {
+    echo 'prepared: ', $count, "\n";
+}
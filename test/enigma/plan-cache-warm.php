@@ -0,0 +1,28 @@
+<?php
+
+$poolOptions = ['pool_size' => 2, 'plan_cache_size' => 1];
+include 'connect.inc';
+
+function preparedStatements()
+{
+    $rows = querya("select pg_backend_pid() as pid, count(*) as c,
+        count(*) filter (where statement like '%::integer * 5 as a%') as own
+        from pg_prepared_statements");
+    return $rows[0];
+}
+
+// Prepared on the first connection
+$rows = querya('select ?::integer * 5 as a', [1], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+
+// Prepared on the second connection
+$rows = querya('select ?::integer * 7 as a', [1], Enigma\Query::CACHE_PLAN);
+echo $rows[0]['a'], "\n";
+
+/*
+ * The plan cache of the first connection is full, so the plan of the
+ * second connection isn't prepared there in place of its own plan.
+ */
+$first = preparedStatements();
+echo 'prepared: ', $first['c'], "\n";
+echo 'own plan kept: ', $first['own'] == 1 ? 'yes' : 'no', "\n";
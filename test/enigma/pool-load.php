@@ -0,0 +1,27 @@
+<?php
+
+include 'connect.inc';
+
+syncQuery('create temporary table enigma_load (id integer primary key, name text)');
+syncQuery("insert into enigma_load values (1, 'one'), (2, 'two'), (3, 'three')");
+
+$lookups = [];
+foreach ([3, 1, 42, 1] as $id) {
+    $lookups[] = $pool->load('enigma_load', 'id', $id);
+}
+
+foreach (\HH\Asio\join(\HH\Asio\v($lookups)) as $row) {
+    echo $row === null ? 'null' : $row['name'], "\n";
+}
+
+syncQuery('create temporary table enigma_load_price (price numeric primary key, name text)');
+syncQuery("insert into enigma_load_price values (1.50, 'cheap'), (2, 'fair')");
+
+$lookups = [];
+foreach (['1.5', 1.5, '1.50', 2, 3] as $price) {
+    $lookups[] = $pool->load('enigma_load_price', 'price', $price);
+}
+
+foreach (\HH\Asio\join(\HH\Asio\v($lookups)) as $row) {
+    echo $row === null ? 'null' : $row['name'] . ' ' . $row['price'], "\n";
+}
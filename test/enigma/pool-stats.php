@@ -0,0 +1,21 @@
+<?php
+
+$poolOptions = ['pool_size' => 2];
+include 'connect.inc';
+
+querya('select 1');
+querya('select ?::integer', [1]);
+try {
+    querya('select * from enigma_missing_table');
+} catch (Enigma\ErrorResult $e) {
+}
+
+$stats = $pool->getStats();
+echo 'connections: ', $stats['connections'], "\n";
+echo 'queue depth: ', $stats['queue_depth'], "\n";
+echo 'enqueued: ', $stats['enqueued'], "\n";
+echo 'completed: ', $stats['completed'], "\n";
+echo 'failed: ', $stats['failed'], "\n";
+echo 'execution count: ', $stats['execution_time']['count'], "\n";
+echo 'execution buckets: ', array_sum($stats['execution_time']['buckets']), "\n";
+echo 'queue wait count: ', $stats['queue_wait_time']['count'], "\n";
@@ -0,0 +1,22 @@
+<?php
+
+include 'connect.inc';
+
+$query = new Enigma\Query('select :a::integer + :b::integer as sum');
+foreach ([[1, 2], [3, 4]] as list($a, $b)) {
+    $query->bind(['a' => $a, 'b' => $b]);
+    var_dump(\HH\Asio\join($pool->asyncQuery($query))->fetchArrays());
+    var_dump($pool->syncQuery($query)->fetchArrays());
+}
+
+$query->enablePlanCache(true);
+$query->setBinaryParams(true);
+$query->bind(['a' => 5, 'b' => 6]);
+var_dump($pool->syncQuery($query)->fetchArrays());
+
+$query->bind(['a' => 5]);
+try {
+    $pool->syncQuery($query);
+} catch (Enigma\ErrorResult $e) {
+    echo trim($e->getMessage()), "\n";
+}
@@ -0,0 +1,29 @@
+<?php
+
+$poolOptions = ['pool_size' => 1];
+include 'connect.inc';
+
+function run($flags, $command = 'select random() as r from pg_sleep(0.1)')
+{
+    global $pool;
+    $queries = [];
+    foreach (range(1, 3) as $i) {
+        $query = new Enigma\Query($command, []);
+        $query->enableCoalescing(($flags & Enigma\Query::COALESCE) != 0);
+        $queries[] = $pool->asyncQuery($query);
+    }
+
+    $values = [];
+    foreach (\HH\Asio\join(\HH\Asio\v($queries)) as $result) {
+        $values[] = $result->fetchArrays()[0]['r'];
+    }
+
+    return count(array_unique($values));
+}
+
+echo 'coalesced: ', run(Enigma\Query::COALESCE), "\n";
+echo 'separate: ', run(0), "\n";
+
+// Statements that modify data are never coalesced
+syncQuery('create temporary table coalesce_test (r serial)');
+echo 'insert: ', run(Enigma\Query::COALESCE, 'insert into coalesce_test default values returning r'), "\n";
@@ -0,0 +1,17 @@
+<?php
+
+include 'connect.inc';
+
+$pool->enableMemoization(true);
+
+$first = querya('select random() as r')[0]['r'];
+echo 'async: ', $first == querya('select random() as r')[0]['r'] ? 'memoized' : 'not memoized', "\n";
+echo 'sync: ', $first == syncQuery('select random() as r')->fetchArrays()[0]['r'] ? 'memoized' : 'not memoized', "\n";
+
+// Statements other than SELECT clear the memo
+syncQuery("set application_name = 'enigma'");
+$second = querya('select random() as r')[0]['r'];
+echo 'after set: ', $first == $second ? 'memoized' : 'not memoized', "\n";
+
+$pool->enableMemoization(false);
+echo 'disabled: ', $second == querya('select random() as r')[0]['r'] ? 'memoized' : 'not memoized', "\n";
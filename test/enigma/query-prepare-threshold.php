@@ -0,0 +1,11 @@
+<?php
+
+$poolOptions = ['prepare_threshold' => 3];
+include 'connect.inc';
+
+$pool->bindConnection();
+for ($i = 1; $i <= 4; $i++) {
+    $rows = syncQuery('select ?::integer as a', [$i], Enigma\Query::CACHE_PLAN)->fetchArrays();
+    $prepared = syncQuery('select count(*) as c from pg_prepared_statements')->fetchArrays();
+    echo $rows[0]['a'], ': ', $prepared[0]['c'], "\n";
+}
@@ -0,0 +1,45 @@
+<?php
+
+include 'connect.inc';
+
+$traced = [];
+$errors = [];
+$pool->setTraceCallback(function ($query, $timings, $error) use (&$traced, &$errors) {
+    $traced[] = $timings;
+    $errors[] = $error;
+});
+
+$timings = query('select pg_sleep(0.01)')->getTimings();
+echo implode(',', array_keys($timings)), "\n";
+var_dump($timings['enqueued'] <= $timings['assigned']
+    && $timings['assigned'] <= $timings['sent']
+    && $timings['sent'] <= $timings['first_byte']
+    && $timings['first_byte'] <= $timings['completed']
+    && $timings['completed'] <= $timings['unserialized']);
+var_dump($timings['completed'] - $timings['sent'] >= 10000);
+var_dump($traced[0] === $timings);
+
+$timings = syncQuery('select 1')->getTimings();
+echo implode(',', array_keys($timings)), "\n";
+var_dump($traced[1] === $timings);
+
+// Failed queries are traced with their error
+try {
+    query('select * from enigma_missing_table');
+} catch (Enigma\ErrorResult $e) {
+    echo implode(',', array_keys($e->getTimings())), "\n";
+    var_dump($traced[2] === $e->getTimings() && $errors[2] === $e);
+}
+
+try {
+    syncQuery('select * from enigma_missing_table');
+} catch (Enigma\ErrorResult $e) {
+    echo implode(',', array_keys($e->getTimings())), "\n";
+    var_dump($traced[3] === $e->getTimings() && $errors[3] === $e);
+}
+
+var_dump($errors[0] === null && $errors[1] === null);
+
+$pool->setTraceCallback(null);
+query('select 1');
+echo 'traced: ', count($traced), "\n";
@@ -0,0 +1,24 @@
+<?php
+
+$poolOptions = ['pool_size' => 1];
+include 'connect.inc';
+
+function taggedQuery()
+{
+    global $pool;
+    $query = new Enigma\Query('select random() as r');
+    $query->enableResultCache(3600, ['enigma_test_tag']);
+    return $pool->syncQuery($query)->fetchArrays()[0]['r'];
+}
+
+// Results are only cached once the listener connection is listening on the tag
+taggedQuery();
+usleep(200000);
+$first = taggedQuery();
+echo $first == taggedQuery() ? 'cached' : 'not cached', "\n";
+
+syncQuery('notify enigma_test_tag');
+usleep(200000);
+$second = taggedQuery();
+echo $first == $second ? 'not invalidated' : 'invalidated', "\n";
+echo $second == taggedQuery() ? 'cached' : 'not cached', "\n";
@@ -0,0 +1,35 @@
+<?php
+
+$poolOptions = ['pool_size' => 1];
+include 'connect.inc';
+
+function cachedQuery($command, $args, $ttl, $async = true)
+{
+    global $pool;
+    $query = new Enigma\Query($command, $args);
+    $query->enableResultCache($ttl);
+    if ($async) {
+        return \HH\Asio\join($pool->asyncQuery($query))->fetchArrays();
+    } else {
+        return $pool->syncQuery($query)->fetchArrays();
+    }
+}
+
+$first = cachedQuery('select random() as r, ?::integer as i', [1], 60);
+$second = cachedQuery('select random() as r, ?::integer as i', [1], 60);
+echo $first[0]['i'], ': ', $first == $second ? 'cached' : 'not cached', "\n";
+
+$other = cachedQuery('select random() as r, ?::integer as i', [2], 60);
+echo $other[0]['i'], ': ', $first[0]['r'] == $other[0]['r'] ? 'cached' : 'not cached', "\n";
+
+$sync = cachedQuery('select random() as r, ?::integer as i', [1], 60, false);
+echo 'sync: ', $first == $sync ? 'cached' : 'not cached', "\n";
+
+$uncached = cachedQuery('select random() as r, ?::integer as i', [1], 0);
+echo 'disabled: ', $first == $uncached ? 'cached' : 'not cached', "\n";
+
+// Statements that modify data are always executed
+syncQuery('create temporary table result_cache_test (r serial)');
+$insert = cachedQuery('insert into result_cache_test default values returning r', [], 60);
+$again = cachedQuery('insert into result_cache_test default values returning r', [], 60);
+echo 'insert: ', $insert == $again ? 'cached' : 'not cached', "\n";
@@ -0,0 +1,14 @@
+<?php
+
+include 'connect.inc';
+
+$sql = <<<'SQL'
+    select array[[1, 2], [3, 4]]::integer[] as i,
+           array[[1.5, null], [2.5, 3]]::float8[] as f,
+           array[[[1]], [[2]]]::integer[] as i3,
+           '[0:1]={5,6}'::integer[] as b1,
+           '[2:3][-1:0]={{a,"b,}"},{NULL,d}}'::text[] as b2
+SQL;
+
+var_dump(querya($sql, [], 0, Enigma\QueryResult::NATIVE));
+var_dump(querya($sql, [], Enigma\Query::BINARY, Enigma\QueryResult::NATIVE));
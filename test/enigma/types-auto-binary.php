@@ -0,0 +1,27 @@
+<?php
+
+include 'connect.inc';
+
+$pool->bindConnection();
+$command = "select ?::integer as i, 9000000000::bigint as b, 't'::bool as t, 'abc'::text as s,
+    1.5::float8 as f, '{\"a\": 1}'::json as j";
+for ($i = 1; $i <= 3; $i++) {
+    $rows = syncQuery($command, [$i], Enigma\Query::CACHE_PLAN)->fetchArrays();
+    var_dump($rows[0]);
+}
+
+// Numeric and date columns keep using the text protocol
+$command = "select ?::integer as i, 1.5::numeric as n, '2015-01-01'::date as d";
+for ($i = 1; $i <= 2; $i++) {
+    $rows = syncQuery($command, [$i], Enigma\Query::CACHE_PLAN)->fetchArrays();
+}
+var_dump($rows[0]);
+
+// Float columns keep using the text protocol, as their text value depends on extra_float_digits
+syncQuery('set extra_float_digits = 0');
+$command = "select ?::integer as i, 0.1::float8 + 0.2::float8 as f";
+for ($i = 1; $i <= 3; $i++) {
+    $rows = syncQuery($command, [$i], Enigma\Query::CACHE_PLAN)->fetchArrays();
+}
+var_dump($rows[0]['f'] === 0.3);
+syncQuery('reset extra_float_digits');
@@ -0,0 +1,24 @@
+<?php
+
+include 'connect.inc';
+
+$rows = querya("select
+    '12345678-9abc-def0-0123-456789abcdef'::uuid as u,
+    '1 year 2 mons 3 days 04:05:06.789'::interval as iv,
+    '-1 days +01:00:00'::interval as iv2,
+    '04:05:06.5'::time as tm,
+    '04:05:06+05:30'::timetz as tmz,
+    '{\"key\": [1, 2]}'::jsonb as jb,
+    '192.168.1.2'::inet as ip,
+    '192.168.1.0/24'::inet as ipm,
+    '2001:db8::1'::inet as ip6,
+    '192.168.0.0/16'::cidr as net,
+    '08:00:2b:01:02:03'::macaddr as mac,
+    '-1234.56'::numeric::money as m,
+    B'101'::bit(3) as b,
+    B'1010010111'::varbit as vb,
+    '1 2 3'::int2vector as i2v,
+    '11 22'::oidvector as ov,
+    array['12345678-9abc-def0-0123-456789abcdef']::uuid[] as ua",
+    [], Enigma\Query::BINARY, Enigma\QueryResult::NATIVE_ARRAYS);
+var_dump($rows);
@@ -0,0 +1,15 @@
+<?php
+
+include 'connect.inc';
+
+$rows = querya(<<<SQL
+    select '2015-01-01'::date as d,
+           '2015-02-02 03:04:05.123123'::timestamp as ts,
+           '2015-02-02 03:04:05.5'::timestamp as ts_str
+SQL
+, [], Enigma\Query::BINARY, Enigma\QueryResult::NATIVE_DATETIME
+);
+var_dump($rows);
+$rows = querya("select '2015-02-02 03:04:05.5'::timestamp as ts, '1999-12-31 23:59:59'::timestamp as ts2",
+    [], Enigma\Query::BINARY);
+var_dump($rows);
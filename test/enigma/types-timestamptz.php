@@ -0,0 +1,10 @@
+<?php
+
+include 'connect.inc';
+
+query("set time zone 'America/New_York'");
+$sql = "select '2015-02-02 03:04:05.123+05'::timestamptz as ts,
+               '2015-07-01 12:00:00+00'::timestamptz as ts_dst";
+var_dump(querya($sql, [], Enigma\Query::BINARY));
+var_dump(querya($sql, [], Enigma\Query::BINARY, Enigma\QueryResult::NATIVE_DATETIME));
+var_dump(querya($sql, [], 0, Enigma\QueryResult::NATIVE_DATETIME));
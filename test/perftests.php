@@ -15,6 +15,10 @@ function pdoQuery($connection, $query, $args, array $opts)
     $fetchFlags = $constructBeforeBinding ? PDO::FETCH_PROPS_LATE : 0;
 
     if (!$stmt) $stmt = $connection->prepare($query);
+    // PDO has no array binding; pass flat arrays as array literals
+    foreach ($args as $arg => $value) {
+        if (is_array($value)) $args[$arg] = '{' . implode(',', $value) . '}';
+    }
     if ($args && is_int(reset(array_keys($args)))) {
         foreach ($args as $arg => $value)
             $stmt->bindValue($arg + 1, $value);
@@ -48,9 +52,20 @@ function enigmaQuery($connection, $query, $args, array $opts)
     $constructBeforeBinding = array_key_exists('constructBeforeBinding', $opts) ? $opts['constructBeforeBinding'] : false;
     if ($constructBeforeBinding) $fetchFlags |= Enigma\QueryResult::CONSTRUCT_BEFORE_BINDING;
 
-    $realQuery = new Enigma\Query($query, $args);
-    if ($queryFlags & Enigma\Query::CACHE_PLAN) $realQuery->enablePlanCache(true);
-    if ($queryFlags & Enigma\Query::BINARY) $realQuery->setBinary(true);
+    $reuse = array_key_exists('reuse', $opts) ? $opts['reuse'] : false;
+    static $queries = [];
+
+    if ($reuse && array_key_exists($query, $queries)) {
+        $realQuery = $queries[$query];
+        $realQuery->bind($args);
+    } else {
+        $realQuery = new Enigma\Query($query, $args);
+        if ($queryFlags & Enigma\Query::CACHE_PLAN) $realQuery->enablePlanCache(true);
+        if ($queryFlags & Enigma\Query::BINARY) $realQuery->setBinary(true);
+        if ($queryFlags & Enigma\Query::BINARY_PARAMS) $realQuery->setBinaryParams(true);
+        if ($reuse) $queries[$query] = $realQuery;
+    }
+
     if ($async) {
         $response = \HH\Asio\join($connection->query($realQuery));
     } else {
@@ -265,6 +280,174 @@ testQuery('Long string / binary',
     [],
     ['queryFlags' => Enigma\Query::BINARY]
 );
+testQuery('UUID / text',
+    "select '12345678-9abc-def0-0123-456789abcdef'::uuid as a, '12345678-9abc-def0-0123-456789abcdef'::uuid as b,
+            '12345678-9abc-def0-0123-456789abcdef'::uuid as c, '12345678-9abc-def0-0123-456789abcdef'::uuid as d,
+            '12345678-9abc-def0-0123-456789abcdef'::uuid as e from generate_series(1, 1000)",
+    []
+);
+testQuery('UUID / binary',
+    "select '12345678-9abc-def0-0123-456789abcdef'::uuid as a, '12345678-9abc-def0-0123-456789abcdef'::uuid as b,
+            '12345678-9abc-def0-0123-456789abcdef'::uuid as c, '12345678-9abc-def0-0123-456789abcdef'::uuid as d,
+            '12345678-9abc-def0-0123-456789abcdef'::uuid as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Interval / text',
+    "select '1 day 04:05:06'::interval as a, '1 day 04:05:06'::interval as b,
+            '1 day 04:05:06'::interval as c, '1 day 04:05:06'::interval as d,
+            '1 day 04:05:06'::interval as e from generate_series(1, 1000)",
+    []
+);
+testQuery('Interval / binary',
+    "select '1 day 04:05:06'::interval as a, '1 day 04:05:06'::interval as b,
+            '1 day 04:05:06'::interval as c, '1 day 04:05:06'::interval as d,
+            '1 day 04:05:06'::interval as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Time / text',
+    "select '04:05:06.5'::time as a, '04:05:06.5'::time as b,
+            '04:05:06.5'::time as c, '04:05:06.5'::time as d,
+            '04:05:06.5'::time as e from generate_series(1, 1000)",
+    []
+);
+testQuery('Time / binary',
+    "select '04:05:06.5'::time as a, '04:05:06.5'::time as b,
+            '04:05:06.5'::time as c, '04:05:06.5'::time as d,
+            '04:05:06.5'::time as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Jsonb / text',
+    "select '{\"key\": \"val\"}'::jsonb as a, '{\"key\": \"val\"}'::jsonb as b,
+            '{\"key\": \"val\"}'::jsonb as c, '{\"key\": \"val\"}'::jsonb as d,
+            '{\"key\": \"val\"}'::jsonb as e from generate_series(1, 1000)",
+    []
+);
+testQuery('Jsonb / binary',
+    "select '{\"key\": \"val\"}'::jsonb as a, '{\"key\": \"val\"}'::jsonb as b,
+            '{\"key\": \"val\"}'::jsonb as c, '{\"key\": \"val\"}'::jsonb as d,
+            '{\"key\": \"val\"}'::jsonb as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Inet / text',
+    "select '192.168.1.2'::inet as a, '192.168.1.2'::inet as b,
+            '192.168.1.2'::inet as c, '192.168.1.2'::inet as d,
+            '192.168.1.2'::inet as e from generate_series(1, 1000)",
+    []
+);
+testQuery('Inet / binary',
+    "select '192.168.1.2'::inet as a, '192.168.1.2'::inet as b,
+            '192.168.1.2'::inet as c, '192.168.1.2'::inet as d,
+            '192.168.1.2'::inet as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Macaddr / text',
+    "select '08:00:2b:01:02:03'::macaddr as a, '08:00:2b:01:02:03'::macaddr as b,
+            '08:00:2b:01:02:03'::macaddr as c, '08:00:2b:01:02:03'::macaddr as d,
+            '08:00:2b:01:02:03'::macaddr as e from generate_series(1, 1000)",
+    []
+);
+testQuery('Macaddr / binary',
+    "select '08:00:2b:01:02:03'::macaddr as a, '08:00:2b:01:02:03'::macaddr as b,
+            '08:00:2b:01:02:03'::macaddr as c, '08:00:2b:01:02:03'::macaddr as d,
+            '08:00:2b:01:02:03'::macaddr as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Timestamp / text',
+    "select '2015-02-02 03:04:05.123'::timestamp as a, '2015-02-02 03:04:05'::timestamp as b,
+            '2015-02-02'::date as c, '2015-02-03'::date as d,
+            '2015-02-02 03:04:05.123'::timestamp as e from generate_series(1, 1000)",
+    []
+);
+testQuery('Timestamp / binary',
+    "select '2015-02-02 03:04:05.123'::timestamp as a, '2015-02-02 03:04:05'::timestamp as b,
+            '2015-02-02'::date as c, '2015-02-03'::date as d,
+            '2015-02-02 03:04:05.123'::timestamp as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Timestamp / text / native',
+    "select '2015-02-02 03:04:05.123'::timestamp as a, '2015-02-02 03:04:05'::timestamp as b,
+            '2015-02-02'::date as c, '2015-02-03'::date as d,
+            '2015-02-02 03:04:05.123'::timestamp as e from generate_series(1, 1000)",
+    [],
+    ['fetchFlags' => Enigma\QueryResult::NATIVE_DATETIME]
+);
+testQuery('Timestamp / binary / native',
+    "select '2015-02-02 03:04:05.123'::timestamp as a, '2015-02-02 03:04:05'::timestamp as b,
+            '2015-02-02'::date as c, '2015-02-03'::date as d,
+            '2015-02-02 03:04:05.123'::timestamp as e from generate_series(1, 1000)",
+    [],
+    ['queryFlags' => Enigma\Query::BINARY, 'fetchFlags' => Enigma\QueryResult::NATIVE_DATETIME]
+);
+testQuery('Large text array / native',
+    "select array_agg('tag-' || i::text) as a, array_agg(case when i % 10 = 0 then 'quoted \"' || i::text || '\"' else i::text end) as b
+     from generate_series(1, 5000) i",
+    [],
+    ['batchSize' => 200, 'fetchFlags' => Enigma\QueryResult::NATIVE_ARRAYS]
+);
+testQuery('Large int array / native',
+    "select array_agg(i) as a from generate_series(1, 10000) i",
+    [],
+    ['batchSize' => 200, 'fetchFlags' => Enigma\QueryResult::NATIVE_ARRAYS]
+);
+testQuery('Float matrix / native',
+    "select array(select array[random(), random(), random(), random()] from generate_series(1, 256)) as m
+     from generate_series(1, 10)",
+    [],
+    ['batchSize' => 20, 'fetchFlags' => Enigma\QueryResult::NATIVE_ARRAYS]
+);
+testQuery('Float matrix / binary',
+    "select array(select array[random(), random(), random(), random()] from generate_series(1, 256)) as m
+     from generate_series(1, 10)",
+    [],
+    ['batchSize' => 20, 'queryFlags' => Enigma\Query::BINARY]
+);
+testQuery('Int params / text',
+    'select ?::bigint + ?::bigint + ?::bigint + ?::bigint as a',
+    [1234567890123, 2345678901234, 3456789012345, 4567890123456]
+);
+testQuery('Int params / binary',
+    'select ?::bigint + ?::bigint + ?::bigint + ?::bigint as a',
+    [1234567890123, 2345678901234, 3456789012345, 4567890123456],
+    ['queryFlags' => Enigma\Query::BINARY_PARAMS]
+);
+testQuery('Large string param',
+    'select length(?) as l',
+    [str_repeat('x', 4 * 1024 * 1024)],
+    ['batchSize' => 50]
+);
+testQuery('Int list / IN',
+    'select x from generate_series(1, 1000) x where x in (' . implode(', ', array_fill(0, 100, '?')) . ')',
+    range(1, 1000, 10),
+    ['queryFlags' => Enigma\Query::CACHE_PLAN]
+);
+testQuery('Int list / ANY binary',
+    'select x from generate_series(1, 1000) x where x = any(?)',
+    [range(1, 1000, 10)],
+    ['queryFlags' => Enigma\Query::CACHE_PLAN | Enigma\Query::BINARY_PARAMS]
+);
+$largeSqlColumns = [];
+$largeSqlParams = [];
+for ($i = 0; $i < 200; $i++) {
+    $largeSqlColumns[] = "/* column $i: ? */ cast(:p$i as integer) as c$i, 'literal :x$i ?' as s$i";
+    $largeSqlParams["p$i"] = $i;
+}
+testQuery('Large SQL text / named params',
+    'select ' . implode(",\n    ", $largeSqlColumns),
+    $largeSqlParams,
+    ['batchSize' => 200]
+);
+testQuery('Large SQL text / reused Query',
+    'select ' . implode(",\n    ", $largeSqlColumns),
+    $largeSqlParams,
+    ['batchSize' => 200, 'reuse' => true]
+);
 
 testQuery('Med cols/Many rows/AssocArray',
     'select 1 as a, 2 as b, 3 as c, 4 as d, 5 as e from generate_series(1, 1000)',